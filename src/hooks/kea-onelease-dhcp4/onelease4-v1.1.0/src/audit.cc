@@ -0,0 +1,586 @@
+/*
+ *
+ * Copyright (2019) Petr Ospalý <petr@ospalax.cz>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ */
+
+
+#include "h/audit.h"
+
+
+/* Header section */
+
+#include <hooks/hooks.h>
+#include <cc/data.h>
+#include <cc/command_interpreter.h>
+#include <dhcp/hwaddr.h>
+#include <dhcpsrv/cfgmgr.h>
+#include <dhcpsrv/lease.h>
+#include <dhcpsrv/lease_mgr.h>
+#include <dhcpsrv/lease_mgr_factory.h>
+#include <dhcpsrv/timer_mgr.h>
+#include <asiolink/interval_timer.h>
+#include <asiolink/io_address.h>
+
+#include <functional>
+#include <algorithm>
+
+#include "h/kea_interface.h"
+#include "h/functions.h"
+#include "h/onelease.h"
+
+using namespace isc::dhcp;
+using namespace isc::hooks;
+using namespace isc::data;
+using namespace isc::config;
+using namespace isc::asiolink;
+
+// The audit instance (exists between load and unload)
+OneLease4AuditPtr kea_onelease4_audit;
+
+// Name of the timer which drives the reading of the leases
+static const std::string AUDIT_TIMER_NAME = "onelease4-audit";
+
+// Limits of the command arguments - one page is read in the main thread so
+// it must stay small, and the workers are not worth more than the cores...
+static const int64_t AUDIT_DEFAULT_PAGE_SIZE = 1000;
+static const int64_t AUDIT_MAX_PAGE_SIZE = 10000;
+static const int64_t AUDIT_MAX_WORKERS = 64;
+
+// Names of the mismatch reasons (indexed by AuditReason)
+static const char* AUDIT_REASON_NAMES[AUDIT_REASONS_COUNT] = {
+    "address-mismatch",
+    "outside-subnets",
+    "not-in-pool",
+    "unknown-subnet"
+};
+
+
+/* Code section */
+
+// Kea's timer manager does not allow (un)registering timers while its worker
+// thread is running - the thread must be started again whatever happens, or
+// all Kea timers (lease reclamation, LFC...) would stop with it.
+//
+// The thread is started even if it was not running before (Kea does not
+// start it when no timers are configured) - the audit timer would never
+// fire otherwise.
+static void register_audit_timer(const std::function<void()>& callback)
+{
+    TimerMgrPtr timer_mgr = TimerMgr::instance();
+
+    if (timer_mgr->threadRunning())
+        timer_mgr->stopThread();
+
+    try {
+        if (timer_mgr->isTimerRegistered(AUDIT_TIMER_NAME))
+            timer_mgr->unregisterTimer(AUDIT_TIMER_NAME);
+        timer_mgr->registerTimer(AUDIT_TIMER_NAME, callback, 1,
+                                 IntervalTimer::ONE_SHOT);
+    } catch (...) {
+        timer_mgr->startThread();
+        throw;
+    }
+
+    timer_mgr->startThread();
+}
+
+static void unregister_audit_timer()
+{
+    TimerMgrPtr timer_mgr = TimerMgr::instance();
+    if (!timer_mgr->isTimerRegistered(AUDIT_TIMER_NAME))
+        return;
+
+    bool thread_running = timer_mgr->threadRunning();
+
+    if (thread_running)
+        timer_mgr->stopThread();
+
+    try {
+        timer_mgr->unregisterTimer(AUDIT_TIMER_NAME);
+    } catch (...) {
+        if (thread_running)
+            timer_mgr->startThread();
+        throw;
+    }
+
+    if (thread_running)
+        timer_mgr->startThread();
+}
+
+OneLease4Audit::OneLease4Audit()
+    : page_size_(0), limit_(0), lower_bound_(IOAddress::IPV4_ZERO_ADDRESS()),
+      max_queued_(0), started_(false), fetch_done_(false), cancelled_(false),
+      running_workers_(0)
+{
+}
+
+OneLease4Audit::~OneLease4Audit()
+{
+    cancel();
+}
+
+void OneLease4Audit::start(const size_t page_size, const size_t workers,
+                           const size_t limit)
+{
+    // the previous audit may have finished but its threads are still around
+    joinWorkers();
+
+    if (!workers_.empty())
+        isc_throw(isc::InvalidOperation, "ONElease4 audit is already running!");
+
+    // take the snapshot of the configuration
+    byte_prefix_ = kea_onelease4_byte_prefix;
+    onelease_subnets_ = kea_onelease4_subnets;
+    subnets_.clear();
+    const Subnet4Collection* subnets =
+        CfgMgr::instance().getCurrentCfg()->getCfgSubnets4()->getAll();
+    for (auto subnet : *subnets)
+        subnets_[subnet->getID()] = subnet;
+
+    page_size_ = page_size;
+    limit_ = limit;
+    lower_bound_ = IOAddress::IPV4_ZERO_ADDRESS();
+
+    // reset the results
+    queue_.clear();
+    max_queued_ = 2 * workers;
+    started_ = true;
+    fetch_done_ = false;
+    cancelled_ = false;
+    running_workers_ = 0;
+    error_.clear();
+    counters_ = AuditCounters();
+    mismatches_.clear();
+    start_time_ = std::chrono::steady_clock::now();
+    end_time_ = start_time_;
+
+    // The timer is registered first - it can fail and there would be nobody
+    // to feed the already running workers. The first page is read on the
+    // next timer event (in the main thread, so not before we return).
+    try {
+        register_audit_timer(std::bind(&OneLease4Audit::fetchPage, this));
+
+        for (size_t i = 0; i < workers; ++i) {
+            workers_.push_back(std::thread(&OneLease4Audit::work, this));
+
+            // workers cannot finish before the first page is read
+            std::lock_guard<std::mutex> lock(mutex_);
+            ++running_workers_;
+        }
+
+        TimerMgr::instance()->setup(AUDIT_TIMER_NAME);
+    } catch (const std::exception& ex) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            cancelled_ = true;
+            error_ = ex.what();
+        }
+
+        // stop and join the workers which were already started
+        cancel();
+        throw;
+    }
+}
+
+void OneLease4Audit::cancel()
+{
+    // the workers must be joined even if the timer cannot be removed (the
+    // callback then finds the audit cancelled and does nothing)
+    std::string error;
+    try {
+        unregister_audit_timer();
+    } catch (const std::exception& ex) {
+        error = ex.what();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (running_workers_ > 0)
+            cancelled_ = true;
+        if (!error.empty())
+            error_ = error;
+        queue_.clear();
+    }
+    cond_.notify_all();
+
+    for (size_t i = 0; i < workers_.size(); ++i)
+        workers_[i].join();
+    workers_.clear();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (cancelled_)
+        end_time_ = std::chrono::steady_clock::now();
+}
+
+void OneLease4Audit::joinWorkers()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (running_workers_ > 0)
+            return;
+    }
+
+    for (size_t i = 0; i < workers_.size(); ++i)
+        workers_[i].join();
+    workers_.clear();
+}
+
+void OneLease4Audit::fetchPage()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (cancelled_ || fetch_done_)
+            return;
+
+        // workers are behind - try again on the next timer event
+        if (queue_.size() >= max_queued_)
+        {
+            TimerMgr::instance()->setup(AUDIT_TIMER_NAME);
+            return;
+        }
+    }
+
+    std::vector<AuditLease> chunk;
+    bool last_page = true;
+    std::string error;
+
+    // Only this one page is read here - this callout runs in the main thread
+    // and it must not delay the packet processing more than necessary...
+    try {
+        Lease4Collection leases = LeaseMgrFactory::instance().getLeases4(
+                lower_bound_, LeasePageSize(page_size_));
+
+        chunk.reserve(leases.size());
+        for (auto lease : leases) {
+            AuditLease audit_lease;
+            audit_lease.addr = lease->addr_.toUint32();
+            audit_lease.subnet_id = lease->subnet_id_;
+            audit_lease.hwaddr = 0;
+            audit_lease.hwaddr_len = 0;
+            if (lease->hwaddr_) {
+                audit_lease.hwaddr = hwaddr_to_uint64(lease->hwaddr_->hwaddr_);
+                audit_lease.hwaddr_len = static_cast<uint8_t>(
+                        std::min(lease->hwaddr_->hwaddr_.size(),
+                                 static_cast<size_t>(HWAddr::MAX_HWADDR_LEN)));
+            }
+            chunk.push_back(audit_lease);
+        }
+
+        if (!leases.empty())
+            lower_bound_ = leases.back()->addr_;
+        last_page = (leases.size() < page_size_);
+    } catch (const std::exception& ex) {
+        error = ex.what();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!chunk.empty())
+            queue_.push_back(std::move(chunk));
+        if (last_page)
+            fetch_done_ = true;
+        if (!error.empty())
+            error_ = error;
+    }
+    cond_.notify_all();
+
+    if (!last_page)
+        TimerMgr::instance()->setup(AUDIT_TIMER_NAME);
+}
+
+void OneLease4Audit::work()
+{
+    AuditCounters counters;
+    std::vector<AuditMismatch> mismatches;
+
+    for (;;) {
+        std::vector<AuditLease> chunk;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cond_.wait(lock, [this] {
+                return (cancelled_ || fetch_done_ || !queue_.empty());
+            });
+
+            if (cancelled_ || queue_.empty())
+                break;
+
+            chunk = std::move(queue_.front());
+            queue_.pop_front();
+        }
+
+        counters = AuditCounters();
+        mismatches.clear();
+        evaluate(chunk, counters, mismatches);
+
+        // merge the results of this chunk
+        std::lock_guard<std::mutex> lock(mutex_);
+        counters_.leases += counters.leases;
+        counters_.skipped += counters.skipped;
+        counters_.matching += counters.matching;
+        for (size_t i = 0; i < AUDIT_REASONS_COUNT; ++i)
+            counters_.mismatches[i] += counters.mismatches[i];
+        for (size_t i = 0; (i < mismatches.size())
+                && (mismatches_.size() < limit_); ++i)
+            mismatches_.push_back(mismatches[i]);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (--running_workers_ == 0)
+        end_time_ = std::chrono::steady_clock::now();
+}
+
+void OneLease4Audit::evaluate(const std::vector<AuditLease> &chunk,
+                              AuditCounters &counters,
+                              std::vector<AuditMismatch> &mismatches) const
+{
+    for (size_t i = 0; i < chunk.size(); ++i) {
+        const AuditLease &lease = chunk[i];
+        ++counters.leases;
+
+        // Only the MAC address has a ONE address (same as in pkt4_receive)
+        bool onelease = (lease.hwaddr_len == ONELEASE4_HWADDR_LEN);
+        for (size_t b = 0; onelease && (b < byte_prefix_.size()); ++b) {
+            uint8_t hw_byte = static_cast<uint8_t>(
+                    lease.hwaddr >> (8 * (lease.hwaddr_len - 1 - b)));
+            onelease = (byte_prefix_[b] == hw_byte);
+        }
+
+        if (!onelease) {
+            ++counters.skipped;
+            continue;
+        }
+
+        // the last four bytes of the HW address
+        uint32_t oneaddr_u32 = packed_hwaddr_to_oneaddr(lease.hwaddr);
+        AuditReason reason = AUDIT_REASONS_COUNT;
+
+        auto subnet = subnets_.find(lease.subnet_id);
+        if (subnet == subnets_.end()) {
+            reason = AUDIT_UNKNOWN_SUBNET;
+        } else {
+            switch (check_onelease4(IOAddress(oneaddr_u32), subnet->second,
+                                    onelease_subnets_)) {
+            case ONELEASE4_VERDICT_ASSIGNED:
+                if (lease.addr != oneaddr_u32)
+                    reason = AUDIT_ADDRESS_MISMATCH;
+                break;
+            case ONELEASE4_VERDICT_SKIPPED_SUBNET:
+                reason = AUDIT_OUTSIDE_SUBNETS;
+                break;
+            default:
+                reason = AUDIT_NOT_IN_POOL;
+                break;
+            }
+        }
+
+        if (reason == AUDIT_REASONS_COUNT) {
+            ++counters.matching;
+            continue;
+        }
+
+        ++counters.mismatches[reason];
+        if (mismatches.size() < limit_) {
+            AuditMismatch mismatch;
+            mismatch.lease = lease;
+            mismatch.oneaddr = oneaddr_u32;
+            mismatch.reason = reason;
+            mismatches.push_back(mismatch);
+        }
+    }
+}
+
+ElementPtr OneLease4Audit::status()
+{
+    joinWorkers();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    ElementPtr result = Element::createMap();
+
+    std::string state = "idle";
+    if (started_)
+        state = cancelled_ ? "cancelled" :
+            (running_workers_ > 0 ? "running" : "finished");
+    result->set("state", Element::create(state));
+
+    if (!started_)
+        return result;
+
+    if (!error_.empty())
+        result->set("error", Element::create(error_));
+
+    std::chrono::steady_clock::time_point end_time =
+        (running_workers_ > 0) ? std::chrono::steady_clock::now() : end_time_;
+    double elapsed =
+        std::chrono::duration<double>(end_time - start_time_).count();
+
+    result->set("elapsed", Element::create(elapsed));
+    result->set("leases",
+                Element::create(static_cast<int64_t>(counters_.leases)));
+    result->set("leases-per-second",
+                Element::create(elapsed > 0 ? counters_.leases / elapsed : 0.0));
+    result->set("skipped",
+                Element::create(static_cast<int64_t>(counters_.skipped)));
+    result->set("matching",
+                Element::create(static_cast<int64_t>(counters_.matching)));
+    for (size_t i = 0; i < AUDIT_REASONS_COUNT; ++i)
+        result->set(AUDIT_REASON_NAMES[i],
+                    Element::create(
+                        static_cast<int64_t>(counters_.mismatches[i])));
+
+    // only the reply is converted into the text form
+    ElementPtr mismatches = Element::createList();
+    for (size_t i = 0; i < mismatches_.size(); ++i) {
+        const AuditMismatch &mismatch = mismatches_[i];
+        std::vector<uint8_t> hwaddr;
+        for (size_t b = mismatch.lease.hwaddr_len; b > 0; --b)
+            hwaddr.push_back(
+                    static_cast<uint8_t>(mismatch.lease.hwaddr >> (8 * (b - 1))));
+
+        ElementPtr entry = Element::createMap();
+        entry->set("ip-address",
+                   Element::create(IOAddress(mismatch.lease.addr).toText()));
+        entry->set("hw-address",
+                   Element::create(HWAddr(hwaddr, HTYPE_ETHER).toText(false)));
+        entry->set("subnet-id",
+                   Element::create(static_cast<int64_t>(
+                           mismatch.lease.subnet_id)));
+        entry->set("one-address",
+                   Element::create(IOAddress(mismatch.oneaddr).toText()));
+        entry->set("reason",
+                   Element::create(std::string(
+                           AUDIT_REASON_NAMES[mismatch.reason])));
+        mismatches->add(entry);
+    }
+    result->set("mismatches", mismatches);
+
+    return result;
+}
+
+
+// Command handler
+//
+// {
+//     "command": "onelease4-audit",
+//     "arguments": {
+//         "action": "start",   // or "status" or "cancel"
+//         "page-size": 1000,   // leases read from the backend at once
+//                              // (1..10000)
+//         "workers": 4,        // number of worker threads (1..64)
+//         "limit": 1000        // maximum of reported mismatches
+//     }
+// }
+int onelease4_audit_command(CalloutHandle& handle)
+{
+    ConstElementPtr response;
+
+    try {
+        ConstElementPtr command;
+        handle.getArgument("command", command);
+
+        ConstElementPtr args;
+        parseCommand(args, command);
+
+        // set defaults
+        std::string action = "start";
+        int64_t page_size = AUDIT_DEFAULT_PAGE_SIZE;
+        int64_t workers = std::min(AUDIT_MAX_WORKERS,
+                static_cast<int64_t>(
+                    std::max(1u, std::thread::hardware_concurrency())));
+        int64_t limit = 1000;
+
+        // check arguments
+
+        if (args)
+        {
+            if (args->getType() != Element::map) {
+                isc_throw(isc::BadValue,
+                          "Arguments of 'onelease4-audit' must be a map!");
+            }
+
+            ConstElementPtr arg_action = args->get("action");
+            ConstElementPtr arg_page_size = args->get("page-size");
+            ConstElementPtr arg_workers = args->get("workers");
+            ConstElementPtr arg_limit = args->get("limit");
+
+            if (arg_action)
+            {
+                if (arg_action->getType() != Element::string) {
+                    isc_throw(isc::BadValue,
+                              "Argument 'action' must be a string!");
+                }
+                action = arg_action->stringValue();
+            }
+
+            if (arg_page_size)
+            {
+                if ((arg_page_size->getType() != Element::integer) ||
+                    (arg_page_size->intValue() <= 0) ||
+                    (arg_page_size->intValue() > AUDIT_MAX_PAGE_SIZE)) {
+                    isc_throw(isc::BadValue,
+                              "Argument 'page-size' must be an integer"
+                              " between 1 and " << AUDIT_MAX_PAGE_SIZE << "!");
+                }
+                page_size = arg_page_size->intValue();
+            }
+
+            if (arg_workers)
+            {
+                if ((arg_workers->getType() != Element::integer) ||
+                    (arg_workers->intValue() <= 0) ||
+                    (arg_workers->intValue() > AUDIT_MAX_WORKERS)) {
+                    isc_throw(isc::BadValue,
+                              "Argument 'workers' must be an integer"
+                              " between 1 and " << AUDIT_MAX_WORKERS << "!");
+                }
+                workers = arg_workers->intValue();
+            }
+
+            if (arg_limit)
+            {
+                if ((arg_limit->getType() != Element::integer) ||
+                    (arg_limit->intValue() < 0)) {
+                    isc_throw(isc::BadValue,
+                              "Argument 'limit' must be a non-negative"
+                              " integer!");
+                }
+                limit = arg_limit->intValue();
+            }
+        }
+
+        if (action == "start") {
+            kea_onelease4_audit->start(static_cast<size_t>(page_size),
+                                       static_cast<size_t>(workers),
+                                       static_cast<size_t>(limit));
+            response = createAnswer(CONTROL_RESULT_SUCCESS,
+                                    "ONElease4 audit started",
+                                    kea_onelease4_audit->status());
+        } else if (action == "status") {
+            response = createAnswer(CONTROL_RESULT_SUCCESS,
+                                    "ONElease4 audit status",
+                                    kea_onelease4_audit->status());
+        } else if (action == "cancel") {
+            kea_onelease4_audit->cancel();
+            response = createAnswer(CONTROL_RESULT_SUCCESS,
+                                    "ONElease4 audit cancelled",
+                                    kea_onelease4_audit->status());
+        } else {
+            isc_throw(isc::BadValue,
+                      "Unknown action '" << action << "' - should be one of:"
+                      " start, status, cancel");
+        }
+    } catch (const std::exception& ex) {
+        response = createAnswer(CONTROL_RESULT_ERROR, ex.what());
+    }
+
+    handle.setArgument("response", response);
+
+    return (KEA_SUCCESS);
+}
+
+
+// last line
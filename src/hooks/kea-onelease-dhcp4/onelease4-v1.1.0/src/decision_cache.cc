@@ -0,0 +1,106 @@
+/*
+ *
+ * Copyright (2019) Petr Ospalý <petr@ospalax.cz>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ */
+
+
+#include "h/decision_cache.h"
+
+
+/* Header section */
+
+#include <dhcpsrv/subnet.h>
+
+#include <ctime>
+
+#include "h/kea_interface.h"
+
+using namespace isc::dhcp;
+
+// Number of the cache entries (must be a power of two)
+static const size_t DECISION_CACHE_SIZE = 4096;
+
+struct DecisionCacheEntry
+{
+    uint64_t hwaddr;
+    uint32_t xid;
+    uint32_t subnet_id;
+    const Subnet4* subnet;      // only for the comparison
+    uint64_t generation;
+    time_t expire;
+    uint32_t oneaddr;
+    OneLease4Verdict verdict;   // ONELEASE4_VERDICT_NONE for an empty entry
+};
+
+static DecisionCacheEntry decision_cache[DECISION_CACHE_SIZE];
+
+
+/* Code section */
+
+static inline size_t decision_cache_index(const uint64_t hwaddr,
+                                          const uint32_t xid,
+                                          const uint32_t subnet_id)
+{
+    uint64_t key = hwaddr ^ (static_cast<uint64_t>(xid) << 16) ^ subnet_id;
+
+    // mix the bits (splitmix64 finalizer)
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+
+    return static_cast<size_t>(key & (DECISION_CACHE_SIZE - 1));
+}
+
+void decision_cache_store(const uint64_t hwaddr, const uint32_t xid,
+                          const Subnet4Ptr &subnet4_ptr,
+                          const OneLease4Verdict verdict,
+                          const uint32_t oneaddr)
+{
+    uint32_t subnet_id = subnet4_ptr->getID();
+    DecisionCacheEntry &entry =
+        decision_cache[decision_cache_index(hwaddr, xid, subnet_id)];
+
+    entry.hwaddr = hwaddr;
+    entry.xid = xid;
+    entry.subnet_id = subnet_id;
+    entry.subnet = subnet4_ptr.get();
+    entry.generation = kea_onelease4_config_generation;
+    entry.expire = time(NULL) + kea_onelease4_decision_cache_ttl;
+    entry.oneaddr = oneaddr;
+    entry.verdict = verdict;
+}
+
+bool decision_cache_take(const uint64_t hwaddr, const uint32_t xid,
+                         const Subnet4Ptr &subnet4_ptr,
+                         OneLease4Verdict &verdict,
+                         uint32_t &oneaddr)
+{
+    uint32_t subnet_id = subnet4_ptr->getID();
+    DecisionCacheEntry &entry =
+        decision_cache[decision_cache_index(hwaddr, xid, subnet_id)];
+
+    if ((entry.verdict == ONELEASE4_VERDICT_NONE) ||
+        (entry.hwaddr != hwaddr) ||
+        (entry.xid != xid) ||
+        (entry.subnet_id != subnet_id) ||
+        (entry.subnet != subnet4_ptr.get()) ||
+        (entry.generation != kea_onelease4_config_generation) ||
+        (entry.expire < time(NULL)))
+        return false;
+
+    verdict = entry.verdict;
+    oneaddr = entry.oneaddr;
+
+    // the decision is used only once
+    entry.verdict = ONELEASE4_VERDICT_NONE;
+
+    return true;
+}
+
+
+// last line
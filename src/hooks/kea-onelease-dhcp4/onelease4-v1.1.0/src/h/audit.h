@@ -0,0 +1,145 @@
+/*
+ *
+ * Copyright (2019) Petr Ospalý <petr@ospalax.cz>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ */
+
+#ifndef SAFEGUARD__AUDIT_H_HEADER__
+#define SAFEGUARD__AUDIT_H_HEADER__
+// do not put any code BEFORE these two lines
+
+
+#include <hooks/hooks.h>
+#include <dhcpsrv/subnet.h>
+#include <asiolink/io_address.h>
+#include <cc/data.h>
+
+#include <boost/shared_ptr.hpp>
+
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <string>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <cstdint>
+
+// Compact lease record which is evaluated by the audit workers - only
+// integers, so the workers never need any string conversion
+struct AuditLease
+{
+    uint32_t addr;          // leased address
+    uint32_t subnet_id;     // Kea subnet id
+    uint64_t hwaddr;        // HW address (see hwaddr_to_uint64)
+    uint8_t hwaddr_len;     // HW address length (zero if there is none)
+};
+
+// Why the lease does not match the ONE lease
+enum AuditReason
+{
+    AUDIT_ADDRESS_MISMATCH = 0,     // leased address is not the ONE address
+    AUDIT_OUTSIDE_SUBNETS,          // ONE address is not in the hook's subnets
+    AUDIT_NOT_IN_POOL,              // ONE address is out of range/pool
+    AUDIT_UNKNOWN_SUBNET,           // lease's subnet is not configured
+    AUDIT_REASONS_COUNT
+};
+
+struct AuditMismatch
+{
+    AuditLease lease;
+    uint32_t oneaddr;
+    AuditReason reason;
+};
+
+struct AuditCounters
+{
+    uint64_t leases = 0;            // all evaluated leases
+    uint64_t skipped = 0;           // leases of non-ONE clients (byte prefix)
+    uint64_t matching = 0;          // ONE leases which are fine
+    uint64_t mismatches[AUDIT_REASONS_COUNT] = {};
+};
+
+// Audit of the stored leases against the ONE lease matching logic.
+//
+// The leases are read from the lease backend page by page in the main thread
+// (one page per timer event) and they are evaluated in parallel by a pool of
+// worker threads. Every page read blocks the packet processing for the time
+// of the backend query - that is why the page size is capped (see
+// AUDIT_MAX_PAGE_SIZE in audit.cc).
+class OneLease4Audit
+{
+public:
+    OneLease4Audit();
+    ~OneLease4Audit();
+
+    // Starts a new audit (throws if one is already running)
+    void start(const size_t page_size, const size_t workers,
+               const size_t limit);
+
+    // Stops the running audit (if any) and joins its workers - the partial
+    // results remain available via status()
+    void cancel();
+
+    // Returns the progress or the results of the last audit
+    isc::data::ElementPtr status();
+
+private:
+    // Timer callback which reads one page of leases (main thread)
+    void fetchPage();
+
+    // Worker thread loop
+    void work();
+
+    // Evaluates one chunk of leases
+    void evaluate(const std::vector<AuditLease> &chunk,
+                  AuditCounters &counters,
+                  std::vector<AuditMismatch> &mismatches) const;
+
+    // Joins the finished worker threads
+    void joinWorkers();
+
+    // Configuration snapshot (read-only while the audit runs)
+    std::vector<uint8_t> byte_prefix_;
+    std::vector<isc::dhcp::Subnet4Ptr> onelease_subnets_;
+    std::unordered_map<uint32_t, isc::dhcp::Subnet4Ptr> subnets_;
+    size_t page_size_;
+    size_t limit_;
+
+    // Backend paging (main thread only)
+    isc::asiolink::IOAddress lower_bound_;
+
+    // Shared state (guarded by the mutex)
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::deque<std::vector<AuditLease> > queue_;
+    size_t max_queued_;
+    bool started_;
+    bool fetch_done_;
+    bool cancelled_;
+    size_t running_workers_;
+    std::string error_;
+    AuditCounters counters_;
+    std::vector<AuditMismatch> mismatches_;
+    std::chrono::steady_clock::time_point start_time_;
+    std::chrono::steady_clock::time_point end_time_;
+
+    std::vector<std::thread> workers_;
+};
+
+typedef boost::shared_ptr<OneLease4Audit> OneLease4AuditPtr;
+
+// The audit instance (exists between load and unload)
+extern OneLease4AuditPtr kea_onelease4_audit;
+
+// Handler of the 'onelease4-audit' control command
+int onelease4_audit_command(isc::hooks::CalloutHandle& handle);
+
+
+// do not put any code AFTER this line
+#endif // SAFEGUARD__AUDIT_H_HEADER__
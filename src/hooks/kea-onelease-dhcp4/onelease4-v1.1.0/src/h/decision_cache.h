@@ -0,0 +1,48 @@
+/*
+ *
+ * Copyright (2019) Petr Ospalý <petr@ospalax.cz>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ */
+
+#ifndef SAFEGUARD__DECISION_CACHE_H_HEADER__
+#define SAFEGUARD__DECISION_CACHE_H_HEADER__
+// do not put any code BEFORE these two lines
+
+
+#include <dhcpsrv/subnet.h>
+
+#include <cstdint>
+
+#include "onelease.h"
+
+// lease4_select is called twice during DORA exchange - for the DISCOVER (fake
+// allocation) and for the REQUEST - and both times with the same result. The
+// decision made for the DISCOVER is stored here (keyed by HW address,
+// transaction id and subnet) and it is taken back for the REQUEST so the
+// matching logic is not repeated.
+//
+// Kea (1.6) processes packets in one thread so the cache needs no locking -
+// it is a small direct-mapped table where a new entry simply replaces the
+// old one. Entries expire after 'decision-cache-ttl' seconds and they are
+// valid only for the configuration generation they were created in.
+
+// Stores the decision made for the fake allocation
+void decision_cache_store(const uint64_t hwaddr, const uint32_t xid,
+                          const isc::dhcp::Subnet4Ptr &subnet4_ptr,
+                          const OneLease4Verdict verdict,
+                          const uint32_t oneaddr);
+
+// Takes (and removes) the decision for the real allocation - returns false
+// if there is no valid decision
+bool decision_cache_take(const uint64_t hwaddr, const uint32_t xid,
+                         const isc::dhcp::Subnet4Ptr &subnet4_ptr,
+                         OneLease4Verdict &verdict,
+                         uint32_t &oneaddr);
+
+
+// do not put any code AFTER this line
+#endif // SAFEGUARD__DECISION_CACHE_H_HEADER__
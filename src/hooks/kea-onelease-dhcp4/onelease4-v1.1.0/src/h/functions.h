@@ -14,12 +14,64 @@
 
 
 #include <dhcpsrv/subnet.h>
+#include <dhcp/hwaddr.h>
 
 #include <vector>
+#include <cstdint>
 
 // Returns Kea structure representing the subnet (smartpointer)
 isc::dhcp::Subnet4Ptr create_subnet4(const std::string subnet_str);
 
+// Returns HW address packed into an integer (the first byte is the highest
+// one) - only the first eight bytes are used
+inline uint64_t hwaddr_to_uint64(const std::vector<uint8_t> &hw_addr)
+{
+    uint64_t result = 0;
+    for (size_t i = 0; (i < hw_addr.size()) && (i < 8); ++i)
+        result = (result << 8) | hw_addr[i];
+
+    return result;
+}
+
+// Same as above but for the (possibly missing) HW address of a lease/packet
+inline uint64_t hwaddr_to_uint64(const isc::dhcp::HWAddrPtr &hwaddr_ptr)
+{
+    return hwaddr_ptr ? hwaddr_to_uint64(hwaddr_ptr->hwaddr_) : 0;
+}
+
+// Returns FNV-1a hash of the HW address - it is used to split clients between
+// the cooperating servers so it must not change between versions
+inline uint32_t hwaddr_hash(const std::vector<uint8_t> &hw_addr)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < hw_addr.size(); ++i) {
+        hash ^= hw_addr[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+// Only the (six bytes long) MAC address carries a ONE address
+const size_t ONELEASE4_HWADDR_LEN = 6;
+
+// Returns the last four bytes of the packed MAC address (see hwaddr_to_uint64)
+// as an IPv4 address in the integer form
+inline uint32_t packed_hwaddr_to_oneaddr(const uint64_t hwaddr)
+{
+    return static_cast<uint32_t>(hwaddr);
+}
+
+// Returns the ONE address of the HW address in the integer form (zero if the
+// HW address is not a MAC address)
+inline uint32_t hwaddr_to_oneaddr(const std::vector<uint8_t> &hw_addr)
+{
+    if (hw_addr.size() != ONELEASE4_HWADDR_LEN)
+        return 0;
+
+    return packed_hwaddr_to_oneaddr(hwaddr_to_uint64(hw_addr));
+}
+
 
 // do not put any code AFTER this line
 #endif // SAFEGUARD__FUNCTIONS_H_HEADER__
@@ -44,6 +44,38 @@ extern std::fstream debug_logfile;
 // subnet list then normal Kea lease will happen...
 extern std::vector<isc::dhcp::Subnet4Ptr> kea_onelease4_subnets;
 
+// Optional renew write suppression - if a renewed lease keeps the ONE address
+// and enough of its lifetime still remains (in percents of the valid lifetime)
+// then the lease is not rewritten in the lease backend...
+extern bool kea_onelease4_renew_skip_write;
+extern uint32_t kea_onelease4_renew_skip_threshold;
+
+// Optional load balancing - clients are split between 'server-count'
+// servers by the hash of their HW address and this server answers only to
+// its own share ('server-index'). If 'server-fallback-secs' is non-zero then
+// this server answers also to the other clients whose 'secs' field reached
+// this value (their owner is probably down)...
+extern uint32_t kea_onelease4_server_index;
+extern uint32_t kea_onelease4_server_count;
+extern uint32_t kea_onelease4_server_fallback_secs;
+
+// Optional DISCOVER->REQUEST decision cache (see decision_cache.h) - entries
+// live for this many seconds (zero disables the cache)
+extern uint32_t kea_onelease4_decision_cache_ttl;
+
+// Configuration generation - it changes with every load of the hook (Kea
+// reloads all hooks on reconfiguration) so cached decisions made with some
+// older configuration are not used
+extern uint64_t kea_onelease4_config_generation;
+
+// Names of the statistics maintained by this hook
+extern const std::string STAT_RENEW_WRITES;
+extern const std::string STAT_RENEW_WRITES_SUPPRESSED;
+extern const std::string STAT_PKT4_NOT_OWNED;
+extern const std::string STAT_PKT4_FALLBACK;
+extern const std::string STAT_DECISION_CACHE_HITS;
+extern const std::string STAT_DECISION_CACHE_MISSES;
+
 // Returns an address and a length from subnet prefix
 std::pair<isc::asiolink::IOAddress, uint8_t>
 parse_subnet_prefix(const std::string& prefix);
@@ -14,8 +14,10 @@
 
 
 #include <hooks/hooks.h>
+#include <dhcp/pkt4.h>
 #include <dhcpsrv/subnet.h>
 #include <dhcpsrv/lease.h>
+#include <asiolink/io_address.h>
 
 #include <vector>
 #include <exception>
@@ -37,11 +39,66 @@ class NonMatchingSubnet : public std::exception
    }
 };
 
-// Here we do all the 'onelease' assignment work
+// Decisions made by this hook (reported by the USDT probes)
+enum OneLease4Verdict
+{
+    ONELEASE4_VERDICT_NONE = 0,             // no decision (missing context)
+    ONELEASE4_VERDICT_ASSIGNED = 1,         // ONE address was assigned
+    ONELEASE4_VERDICT_REJECTED = 2,         // ONE address is out of range/pool
+    ONELEASE4_VERDICT_SKIPPED_PREFIX = 3,   // byte prefix does not match
+    ONELEASE4_VERDICT_SKIPPED_SUBNET = 4,   // not in the hook's subnets
+    ONELEASE4_VERDICT_RENEW_SUPPRESSED = 5, // renew was not written
+    ONELEASE4_VERDICT_NOT_OWNED = 6,        // client belongs to other server
+    ONELEASE4_VERDICT_FALLBACK = 7          // answered for other server
+};
+
+// Here we do all the 'onelease' assignment work (the decision and the ONE
+// address can be returned via the optional pointers)
 int kea_onelease4(isc::hooks::CalloutHandle& handle,
                   isc::dhcp::Subnet4Ptr subnet4_ptr,
                   isc::dhcp::Lease4Ptr lease4_ptr,
-                  const std::string callout_name);
+                  const std::string callout_name,
+                  OneLease4Verdict *result_verdict = NULL,
+                  uint32_t *result_oneaddr = NULL);
+
+// Applies the decision made earlier by kea_onelease4() (decision cache)
+int apply_onelease4_verdict(isc::hooks::CalloutHandle& handle,
+                            isc::dhcp::Lease4Ptr lease4_ptr,
+                            const OneLease4Verdict verdict,
+                            const uint32_t oneaddr,
+                            const std::string callout_name);
+
+// Decides if the ONE address can be assigned within the Kea subnet - this is
+// the matching logic of kea_onelease4() without any callout context
+OneLease4Verdict check_onelease4(
+        const isc::asiolink::IOAddress &oneaddr,
+        const isc::dhcp::Subnet4Ptr &subnet4_ptr,
+        const std::vector<isc::dhcp::Subnet4Ptr> &subnets);
+
+// Checks if this server should answer the client (load balancing)
+bool is_onelease4_owner(const isc::dhcp::Pkt4Ptr &query4_ptr);
+
+// Checks if the client is talking to this server in particular (it knows our
+// server identifier or it holds our lease) - such a client must be answered
+// regardless of the load balancing
+bool is_onelease4_addressed(const isc::dhcp::Pkt4Ptr &query4_ptr);
+
+// Skips the lease backend update on renew when the ONE lease is unchanged and
+// the stored lease is still far enough from its expiration
+bool suppress_onelease4_renew(isc::hooks::CalloutHandle& handle,
+                              const isc::asiolink::IOAddress &curaddr,
+                              const uint32_t threshold);
+
+// Remembers the lifetime of the ONE lease which is written into the lease
+// backend (used instead of reading the stored lease on renew)
+void record_onelease4_write(const isc::dhcp::Lease4Ptr &lease4_ptr);
+
+// Forgets all the remembered writes
+void clear_onelease4_writes();
+
+// Sets the lease time (and T1/T2 in the same ratio) in the response
+void set_onelease4_lifetimes(const isc::dhcp::Pkt4Ptr &response4_ptr,
+                             const uint32_t valid_lft);
 
 // Checks and compares the byte prefix with the HW address
 bool match_byte_prefix(const std::vector<uint8_t> &byte_prefix,
@@ -0,0 +1,87 @@
+/*
+ *
+ * Copyright (2019) Petr Ospalý <petr@ospalax.cz>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ */
+
+#ifndef SAFEGUARD__PROBES_H_HEADER__
+#define SAFEGUARD__PROBES_H_HEADER__
+// do not put any code BEFORE these two lines
+
+
+// USDT (static tracepoints) for tracing of the lease decisions on a running
+// Kea (bpftrace, perf, systemtap...).
+//
+// Every probe is a 'nop' instruction guarded by a semaphore - a tracer
+// increments the semaphore when it attaches, so until then the probe costs
+// only one (well predicted) test of the semaphore and the probe arguments are
+// not even computed.
+//
+// All probes are in the 'onelease4' provider and they are used only if the
+// 'sys/sdt.h' header is present (systemtap-sdt-dev or similar package) and
+// the build did not define ONELEASE4_NO_USDT (see Makefile.config).
+//
+// Probe arguments:
+//  mac:        HW address packed into the lowest six bytes of uint64
+//  oneaddr:    ONE address as uint32 (zero if HW address has no ONE address)
+//  subnet_id:  Kea subnet id
+//  verdict:    one of the OneLease4Verdict values (see onelease.h)
+
+#if defined(__has_include)
+#   if __has_include(<sys/sdt.h>) && !defined(ONELEASE4_NO_USDT)
+#       define ONELEASE4_USDT 1
+#   endif
+#endif
+
+#ifdef ONELEASE4_USDT
+
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+
+// Semaphores are referenced from the probe notes by their plain (C) names
+// and they are defined in probes.cc - every probe must have one
+#define ONELEASE4_SEMAPHORE(name) onelease4_##name##_semaphore
+
+extern "C" {
+    extern volatile unsigned short onelease4_pkt4_receive_entry_semaphore;
+    extern volatile unsigned short onelease4_pkt4_receive_return_semaphore;
+    extern volatile unsigned short onelease4_onelease4_entry_semaphore;
+    extern volatile unsigned short onelease4_onelease4_verdict_semaphore;
+    extern volatile unsigned short onelease4_onelease4_return_semaphore;
+    extern volatile unsigned short onelease4_pkt4_send_semaphore;
+}
+
+#define ONELEASE4_PROBE_ENABLED(name) \
+    __builtin_expect(ONELEASE4_SEMAPHORE(name), 0)
+
+#define ONELEASE4_PROBE1(name, a1) \
+    do { if (ONELEASE4_PROBE_ENABLED(name)) \
+        DTRACE_PROBE1(onelease4, name, a1); } while (0)
+#define ONELEASE4_PROBE2(name, a1, a2) \
+    do { if (ONELEASE4_PROBE_ENABLED(name)) \
+        DTRACE_PROBE2(onelease4, name, a1, a2); } while (0)
+#define ONELEASE4_PROBE4(name, a1, a2, a3, a4) \
+    do { if (ONELEASE4_PROBE_ENABLED(name)) \
+        DTRACE_PROBE4(onelease4, name, a1, a2, a3, a4); } while (0)
+
+#else
+
+// arguments are never evaluated - they are only "used" in the dead code so
+// we do not get warnings about unused variables
+#define ONELEASE4_PROBE1(name, a1) \
+    do { if (0) { (void)(a1); } } while (0)
+#define ONELEASE4_PROBE2(name, a1, a2) \
+    do { if (0) { (void)(a1); (void)(a2); } } while (0)
+#define ONELEASE4_PROBE4(name, a1, a2, a3, a4) \
+    do { if (0) { (void)(a1); (void)(a2); (void)(a3); (void)(a4); } } \
+    while (0)
+
+#endif
+
+
+// do not put any code AFTER this line
+#endif // SAFEGUARD__PROBES_H_HEADER__
@@ -18,13 +18,17 @@
 #include <cc/data.h>
 #include <util/strutil.h>
 #include <dhcpsrv/subnet.h>
+#include <stats/stats_mgr.h>
 
 #include "h/functions.h"
+#include "h/audit.h"
+#include "h/onelease.h"
 
 using namespace isc::dhcp;
 using namespace isc::hooks;
 using namespace isc::data;
 using namespace isc::util;
+using namespace isc::stats;
 
 // Kea has reversed boolean values...
 int KEA_SUCCESS = 0;
@@ -42,6 +46,29 @@ std::vector<uint8_t> kea_onelease4_byte_prefix;
 // Debug log (if enabled)
 std::fstream debug_logfile;
 
+// Renew write suppression (disabled by default)
+bool kea_onelease4_renew_skip_write = false;
+uint32_t kea_onelease4_renew_skip_threshold = 30;
+
+// Load balancing (disabled by default - one server answers all)
+uint32_t kea_onelease4_server_index = 0;
+uint32_t kea_onelease4_server_count = 1;
+uint32_t kea_onelease4_server_fallback_secs = 0;
+
+// Decision cache (entries are valid only within one generation)
+uint32_t kea_onelease4_decision_cache_ttl = 10;
+uint64_t kea_onelease4_config_generation = 0;
+
+// Statistics
+const std::string STAT_RENEW_WRITES = "onelease4-renew-writes";
+const std::string STAT_RENEW_WRITES_SUPPRESSED =
+    "onelease4-renew-writes-suppressed";
+const std::string STAT_PKT4_NOT_OWNED = "onelease4-pkt4-not-owned";
+const std::string STAT_PKT4_FALLBACK = "onelease4-pkt4-fallback";
+const std::string STAT_DECISION_CACHE_HITS = "onelease4-decision-cache-hits";
+const std::string STAT_DECISION_CACHE_MISSES =
+    "onelease4-decision-cache-misses";
+
 
 /* Code section */
 
@@ -63,6 +90,12 @@ extern "C" {
         //     "enabled": true,
         //     "byte-prefix": "",
         //     "subnets": [],
+        //     "renew-skip-write": false,
+        //     "renew-skip-threshold": 30,
+        //     "server-index": 0,
+        //     "server-count": 1,
+        //     "server-fallback-secs": 0,
+        //     "decision-cache-ttl": 10,
         //     "logger-name": "kea-onelease-dhcp4",
         //     "debug": true,
         //     "debug-logfile": "/var/log/kea-onelease-dhcp4-debug.log"
@@ -70,6 +103,18 @@ extern "C" {
         ConstElementPtr param_enabled = handle.getParameter("enabled");
         ConstElementPtr param_byte_prefix = handle.getParameter("byte-prefix");
         ConstElementPtr param_subnets = handle.getParameter("subnets");
+        ConstElementPtr param_renew_skip_write =
+            handle.getParameter("renew-skip-write");
+        ConstElementPtr param_renew_skip_threshold =
+            handle.getParameter("renew-skip-threshold");
+        ConstElementPtr param_server_index =
+            handle.getParameter("server-index");
+        ConstElementPtr param_server_count =
+            handle.getParameter("server-count");
+        ConstElementPtr param_server_fallback_secs =
+            handle.getParameter("server-fallback-secs");
+        ConstElementPtr param_decision_cache_ttl =
+            handle.getParameter("decision-cache-ttl");
         ConstElementPtr param_logger_name = handle.getParameter("logger-name");
         ConstElementPtr param_debug = handle.getParameter("debug");
         ConstElementPtr param_debug_logfile = handle.getParameter("debug-logfile");
@@ -136,6 +181,109 @@ extern "C" {
             }
         }
 
+        if (param_renew_skip_write)
+        {
+            if (param_renew_skip_write->getType() != Element::boolean) {
+                isc_throw(isc::BadValue,
+                          "Parameter 'renew-skip-write' must be a boolean!");
+            }
+            kea_onelease4_renew_skip_write =
+                param_renew_skip_write->boolValue();
+        }
+
+        if (param_renew_skip_threshold)
+        {
+            if (param_renew_skip_threshold->getType() != Element::integer) {
+                isc_throw(isc::BadValue,
+                          "Parameter 'renew-skip-threshold' must be an integer!");
+            }
+
+            // validate threshold (percents of the valid lifetime) - every
+            // suppressed renew halves the lifetime given to the client so
+            // too low threshold would only multiply the renews
+            int64_t threshold = param_renew_skip_threshold->intValue();
+            if ((threshold < 10) || (threshold > 100))
+            {
+                isc_throw(isc::BadValue,
+                          "Wrong renew skip threshold - should be a percentage"
+                          " between 10 and 100!");
+            }
+            kea_onelease4_renew_skip_threshold =
+                static_cast<uint32_t>(threshold);
+        }
+
+        if (param_server_count)
+        {
+            if (param_server_count->getType() != Element::integer) {
+                isc_throw(isc::BadValue,
+                          "Parameter 'server-count' must be an integer!");
+            }
+
+            int64_t server_count = param_server_count->intValue();
+            if ((server_count < 1) || (server_count > 255))
+            {
+                isc_throw(isc::BadValue,
+                          "Wrong server count - should be between 1 and 255!");
+            }
+            kea_onelease4_server_count = static_cast<uint32_t>(server_count);
+        }
+
+        if (param_server_index)
+        {
+            if (param_server_index->getType() != Element::integer) {
+                isc_throw(isc::BadValue,
+                          "Parameter 'server-index' must be an integer!");
+            }
+
+            // validate index (zero-based)
+            int64_t server_index = param_server_index->intValue();
+            if ((server_index < 0) ||
+                (server_index >= kea_onelease4_server_count))
+            {
+                isc_throw(isc::BadValue,
+                          "Wrong server index - should be between 0 and"
+                          " server-count - 1!");
+            }
+            kea_onelease4_server_index = static_cast<uint32_t>(server_index);
+        }
+
+        if (param_server_fallback_secs)
+        {
+            if (param_server_fallback_secs->getType() != Element::integer) {
+                isc_throw(isc::BadValue,
+                          "Parameter 'server-fallback-secs' must be"
+                          " an integer!");
+            }
+
+            // 'secs' field in DHCP packet is only two bytes
+            int64_t fallback_secs = param_server_fallback_secs->intValue();
+            if ((fallback_secs < 0) || (fallback_secs > 65535))
+            {
+                isc_throw(isc::BadValue,
+                          "Wrong server fallback secs - should be between"
+                          " 0 and 65535!");
+            }
+            kea_onelease4_server_fallback_secs =
+                static_cast<uint32_t>(fallback_secs);
+        }
+
+        if (param_decision_cache_ttl)
+        {
+            if (param_decision_cache_ttl->getType() != Element::integer) {
+                isc_throw(isc::BadValue,
+                          "Parameter 'decision-cache-ttl' must be an integer!");
+            }
+
+            int64_t ttl = param_decision_cache_ttl->intValue();
+            if ((ttl < 0) || (ttl > 3600))
+            {
+                isc_throw(isc::BadValue,
+                          "Wrong decision cache ttl - should be between"
+                          " 0 and 3600 seconds!");
+            }
+            kea_onelease4_decision_cache_ttl = static_cast<uint32_t>(ttl);
+        }
+
         if (param_debug)
         {
             if (param_debug->getType() != Element::boolean) {
@@ -163,6 +311,22 @@ extern "C" {
             logger_name = param_logger_name->stringValue();
         }
 
+        // forget everything cached with the previous configuration
+        ++kea_onelease4_config_generation;
+
+        // control commands
+        kea_onelease4_audit.reset(new OneLease4Audit());
+        handle.registerCommandHandler("onelease4-audit",
+                                      onelease4_audit_command);
+
+        // initialize statistics so they are reported even before first use
+        StatsMgr::instance().setValue(STAT_RENEW_WRITES, int64_t(0));
+        StatsMgr::instance().setValue(STAT_RENEW_WRITES_SUPPRESSED, int64_t(0));
+        StatsMgr::instance().setValue(STAT_PKT4_NOT_OWNED, int64_t(0));
+        StatsMgr::instance().setValue(STAT_PKT4_FALLBACK, int64_t(0));
+        StatsMgr::instance().setValue(STAT_DECISION_CACHE_HITS, int64_t(0));
+        StatsMgr::instance().setValue(STAT_DECISION_CACHE_MISSES, int64_t(0));
+
         // Are we debugging?
         if (debug)
         {
@@ -176,6 +340,21 @@ extern "C" {
                 << "DEBUG> onelease hook: " << \
                     std::string(kea_onelease4_enabled \
                             ? "ENABLED" : "DISABLED") \
+                << "\n" \
+                << "DEBUG> renew write suppression: " << \
+                    std::string(kea_onelease4_renew_skip_write \
+                            ? "ENABLED" : "DISABLED") \
+                << " (threshold: " << kea_onelease4_renew_skip_threshold \
+                << "%)" \
+                << "\n" \
+                << "DEBUG> load balancing: server " \
+                << kea_onelease4_server_index << " of " \
+                << kea_onelease4_server_count \
+                << " (fallback secs: " << kea_onelease4_server_fallback_secs \
+                << ")" \
+                << "\n" \
+                << "DEBUG> decision cache ttl: " \
+                << kea_onelease4_decision_cache_ttl << "s" \
                 << "\n";
 
             // to guard against a crash, we'll flush the output stream
@@ -193,6 +372,19 @@ extern "C" {
     // value on an error. The hooks framework will record a non-zero status
     // return as an error in the current Kea log but otherwise ignore it.
     int unload() {
+        // stop the running audit (if any)
+        kea_onelease4_audit.reset();
+
+        // the backend may be changed before we are loaded again
+        clear_onelease4_writes();
+
+        StatsMgr::instance().del(STAT_RENEW_WRITES);
+        StatsMgr::instance().del(STAT_RENEW_WRITES_SUPPRESSED);
+        StatsMgr::instance().del(STAT_PKT4_NOT_OWNED);
+        StatsMgr::instance().del(STAT_PKT4_FALLBACK);
+        StatsMgr::instance().del(STAT_DECISION_CACHE_HITS);
+        StatsMgr::instance().del(STAT_DECISION_CACHE_MISSES);
+
         if (debug_logfile) {
             // closing debug log with last message
             debug_logfile \
@@ -16,17 +16,41 @@
 
 #include <hooks/hooks.h>
 #include <dhcp/pkt4.h>
+#include <dhcp/dhcp4.h>
+#include <dhcp/option_int.h>
 #include <dhcpsrv/subnet.h>
 #include <dhcpsrv/lease.h>
+#include <dhcpsrv/lease_mgr.h>
+#include <dhcpsrv/lease_mgr_factory.h>
 #include <asiolink/io_address.h>
+#include <stats/stats_mgr.h>
 
 #include <string>
+#include <ctime>
+#include <algorithm>
+#include <unordered_map>
 
 #include "h/kea_interface.h"
 #include "h/functions.h"
+#include "h/probes.h"
+#include "h/decision_cache.h"
 
 using namespace isc::dhcp;
 using namespace isc::hooks;
+using namespace isc::stats;
+
+// Lifetime of the ONE lease as it was last written into the lease backend
+// (see record_onelease4_write)
+struct OneLease4Write
+{
+    uint64_t hwaddr;
+    int64_t cltt;
+    uint32_t valid_lft;
+};
+
+// The last writes of the ONE leases keyed by the address - so we do not need
+// to read the stored lease from the backend on every renew...
+static std::unordered_map<uint32_t, OneLease4Write> onelease4_writes;
 
 
 /* Code section */
@@ -51,6 +75,18 @@ extern "C" {
         // Point to the hardware address.
         HWAddrPtr hwaddr_ptr = query4_ptr->getHWAddr();
 
+        ONELEASE4_PROBE1(pkt4_receive_entry, hwaddr_to_uint64(hwaddr_ptr));
+
+        // Load balancing - drop the packet if the client belongs to some
+        // other server...
+        if (kea_onelease4_enabled && !is_onelease4_owner(query4_ptr))
+        {
+            handle.setStatus(CalloutHandle::NEXT_STEP_DROP);
+            ONELEASE4_PROBE2(pkt4_receive_return,
+                             hwaddr_to_uint64(hwaddr_ptr), uint32_t(0));
+            return (KEA_SUCCESS);
+        }
+
         // Context
 
         // Store the text form of the hardware address in the context to pass
@@ -60,10 +96,14 @@ extern "C" {
 
         // Store the last four bytes of the HW address as an ip address which
         // is created by simple conversion from said HW address - or leave it
-        // empty if it does not match byte prefix...
+        // empty if it does not match byte prefix or it is not a MAC address
+        // (the lease audit must come to the same ONE address)...
         std::string oneaddr_str = "";
-        if (match_byte_prefix(kea_onelease4_byte_prefix, hwaddr_ptr->hwaddr_))
+        uint32_t oneaddr_u32 = 0;
+        if ((hwaddr_ptr->hwaddr_.size() == ONELEASE4_HWADDR_LEN) &&
+            match_byte_prefix(kea_onelease4_byte_prefix, hwaddr_ptr->hwaddr_))
         {
+            oneaddr_u32 = hwaddr_to_oneaddr(hwaddr_ptr->hwaddr_);
             for (unsigned int i = 2; i < hwaddr_ptr->hwaddr_.size(); ++i) {
                 oneaddr_str += std::to_string(hwaddr_ptr->hwaddr_[i]);
                 oneaddr_str += (i + 1) < hwaddr_ptr->hwaddr_.size() ? "." : "";
@@ -71,6 +111,14 @@ extern "C" {
         }
         handle.setContext("oneaddr_str", oneaddr_str);
 
+        // remaining lifetime of the stored lease if its renew was not written
+        // (zero otherwise) - see suppress_onelease4_renew
+        if (kea_onelease4_renew_skip_write)
+            handle.setContext("renew_suppressed_lft", uint32_t(0));
+
+        ONELEASE4_PROBE2(pkt4_receive_return,
+                         hwaddr_to_uint64(hwaddr_ptr), oneaddr_u32);
+
         return (KEA_SUCCESS);
     };
 
@@ -85,12 +133,69 @@ extern "C" {
         if (!(kea_onelease4_enabled))
             return KEA_SUCCESS;
 
-        // Pkt4Ptr query4_ptr;      // IN
+        Pkt4Ptr query4_ptr;         // IN
         Subnet4Ptr subnet4_ptr;     // IN
         Lease4Ptr lease4_ptr;       // IN/OUT
-        // bool fake_allocation;    // IN (I don't have use for it for now)
+        bool fake_allocation;       // IN
+
+        OneLease4Verdict verdict = ONELEASE4_VERDICT_NONE;
+        uint32_t oneaddr_u32 = 0;
+        int result = KEA_SUCCESS;
+
+        handle.getArgument("fake_allocation", fake_allocation);
+
+        if (kea_onelease4_decision_cache_ttl == 0)
+        {
+            // without the decision cache it is the same as for the
+            // lease4_renew
+            result = kea_onelease4(handle, subnet4_ptr, lease4_ptr,
+                                   "lease4_select", &verdict, &oneaddr_u32);
+        } else {
+            handle.getArgument("query4", query4_ptr);
+            handle.getArgument("subnet4", subnet4_ptr);
+            handle.getArgument("lease4", lease4_ptr);
+
+            // decision cache key
+            uint64_t hwaddr_u64 = hwaddr_to_uint64(lease4_ptr->hwaddr_);
+            uint32_t xid = query4_ptr->getTransid();
+
+            // REQUEST - the decision was probably already made for the
+            // DISCOVER
+            bool cached = false;
+            if (!fake_allocation)
+            {
+                cached = decision_cache_take(hwaddr_u64, xid, subnet4_ptr,
+                                             verdict, oneaddr_u32);
+                StatsMgr::instance().addValue(cached ?
+                                              STAT_DECISION_CACHE_HITS :
+                                              STAT_DECISION_CACHE_MISSES,
+                                              int64_t(1));
+            }
+
+            if (cached) {
+                result = apply_onelease4_verdict(handle, lease4_ptr, verdict,
+                                                 oneaddr_u32, "lease4_select");
+            } else {
+                result = kea_onelease4(handle, subnet4_ptr, lease4_ptr,
+                                       "lease4_select", &verdict,
+                                       &oneaddr_u32);
+            }
 
-        return kea_onelease4(handle, subnet4_ptr, lease4_ptr, "lease4_select");
+            // DISCOVER - remember the decision for the REQUEST
+            if (fake_allocation && (verdict != ONELEASE4_VERDICT_NONE))
+                decision_cache_store(hwaddr_u64, xid, subnet4_ptr,
+                                     verdict, oneaddr_u32);
+        }
+
+        // REQUEST - the new ONE lease will be written into the backend
+        if (kea_onelease4_renew_skip_write && !fake_allocation &&
+            (verdict == ONELEASE4_VERDICT_ASSIGNED))
+        {
+            handle.getArgument("lease4", lease4_ptr);
+            record_onelease4_write(lease4_ptr);
+        }
+
+        return result;
     }
 
     // This callout is called at the "lease4_renew" hook.
@@ -110,7 +215,27 @@ extern "C" {
         Subnet4Ptr subnet4_ptr;     // IN
         Lease4Ptr lease4_ptr;       // IN/OUT
 
-        return kea_onelease4(handle, subnet4_ptr, lease4_ptr, "lease4_renew");
+        // remember the currently leased address before the ONE lease is
+        // applied - we need it to decide if the backend must be updated
+        handle.getArgument("lease4", lease4_ptr);
+        isc::asiolink::IOAddress curaddr = lease4_ptr->addr_;
+
+        int result = kea_onelease4(handle, subnet4_ptr, lease4_ptr,
+                                   "lease4_renew");
+
+        // Kea extends the existing lease also for the DISCOVER (offer) but
+        // then nothing is written into the backend...
+        if (kea_onelease4_renew_skip_write)
+        {
+            Pkt4Ptr query4_ptr;
+            handle.getArgument("query4", query4_ptr);
+
+            if (query4_ptr->getType() != DHCPDISCOVER)
+                suppress_onelease4_renew(handle, curaddr,
+                                         kea_onelease4_renew_skip_threshold);
+        }
+
+        return result;
     }
 
     // This callout is called at the "pkt4_send" hook.
@@ -126,15 +251,35 @@ extern "C" {
         std::string hwaddr_str;
         std::string oneaddr_str;
 
+        Pkt4Ptr response4_ptr;
+        handle.getArgument("response4", response4_ptr);
+
+        ONELEASE4_PROBE2(pkt4_send,
+                         hwaddr_to_uint64(response4_ptr->getHWAddr()),
+                         response4_ptr->getYiaddr().toUint32());
+
+        // The renew was not written - Kea answers with the full lifetime but
+        // the stored lease expires sooner, so the client must be told only
+        // what remains of it...
+        if (kea_onelease4_renew_skip_write)
+        {
+            uint32_t remaining_lft = 0;
+            try {
+                handle.getContext("renew_suppressed_lft", remaining_lft);
+            } catch (const NoSuchCalloutContext&) {
+                // packet was not seen by pkt4_receive
+            }
+
+            if (remaining_lft > 0)
+                set_onelease4_lifetimes(response4_ptr, remaining_lft);
+        }
+
         // I am being defensive here and I will use try..catch even though the
         // context should have been set...
         try {
             handle.getContext("hwaddr_str", hwaddr_str);
             handle.getContext("oneaddr_str", oneaddr_str);
 
-            Pkt4Ptr response4_ptr;
-            handle.getArgument("response4", response4_ptr);
-
             // Get the string form of the IP address.
             std::string ipaddr_str = response4_ptr->getYiaddr().toText();
 
@@ -167,16 +312,32 @@ extern "C" {
 int kea_onelease4(CalloutHandle& handle,
                   Subnet4Ptr subnet4_ptr,
                   Lease4Ptr lease4_ptr,
-                  const std::string callout_name)
+                  const std::string callout_name,
+                  OneLease4Verdict *result_verdict,
+                  uint32_t *result_oneaddr)
 {
     // read the current state
     handle.getArgument("subnet4", subnet4_ptr);
     handle.getArgument("lease4", lease4_ptr);
 
+    // probe arguments (the HW address is converted only for an attached
+    // tracer - see probes.h)
+    uint32_t oneaddr_u32 = 0;
+    uint32_t subnet_id = subnet4_ptr->getID();
+    int verdict = ONELEASE4_VERDICT_NONE;
+
+    ONELEASE4_PROBE4(onelease4_entry, hwaddr_to_uint64(lease4_ptr->hwaddr_),
+                     lease4_ptr->addr_.toUint32(), subnet_id,
+                     callout_name.c_str());
+
     // I am being defensive here and I will use try..catch even though the
     // context should have been set...
     std::string hwaddr_str;
     std::string oneaddr_str;
+
+    // nothing was assigned (yet)
+    handle.setContext("onelease_applied", false);
+
     try {
         handle.getContext("hwaddr_str", hwaddr_str);
         handle.getContext("oneaddr_str", oneaddr_str);
@@ -188,17 +349,16 @@ int kea_onelease4(CalloutHandle& handle,
         // Try to convert string into IPv4 representation
         isc::asiolink::IOAddress
             oneaddr = isc::asiolink::IOAddress(oneaddr_str);
+        oneaddr_u32 = oneaddr.toUint32();
+
+        OneLease4Verdict onelease_verdict =
+            check_onelease4(oneaddr, subnet4_ptr, kea_onelease4_subnets);
 
         // Do not apply hook if ONE subnet restriction is invalid
-        if (!is_onelease4_in_range(oneaddr, kea_onelease4_subnets))
+        if (onelease_verdict == ONELEASE4_VERDICT_SKIPPED_SUBNET)
             throw NonMatchingSubnet();
 
-        // The inRange() test is actually redundant because it is also done
-        // in the method inPool() but I know that only because I looked
-        // into the implementation - and that can change so I am defensive
-        // here...
-        if (subnet4_ptr->inRange(oneaddr) &&
-            subnet4_ptr->inPool(Lease::TYPE_V4, oneaddr))
+        if (onelease_verdict == ONELEASE4_VERDICT_ASSIGNED)
         {
             // OK - ONE address can be assigned
 
@@ -225,6 +385,12 @@ int kea_onelease4(CalloutHandle& handle,
             // modified lease
             lease4_ptr->addr_ = oneaddr;
             std::string lease_str = lease4_ptr->toText();
+            handle.setContext("onelease_applied", true);
+
+            verdict = ONELEASE4_VERDICT_ASSIGNED;
+            ONELEASE4_PROBE4(onelease4_verdict,
+                             hwaddr_to_uint64(lease4_ptr->hwaddr_), oneaddr_u32,
+                             subnet_id, verdict);
 
             if (debug_logfile)
             {
@@ -246,6 +412,11 @@ int kea_onelease4(CalloutHandle& handle,
             handle.setStatus(CalloutHandle::NEXT_STEP_SKIP);
             lease4_ptr->decline(0);
 
+            verdict = ONELEASE4_VERDICT_REJECTED;
+            ONELEASE4_PROBE4(onelease4_verdict,
+                             hwaddr_to_uint64(lease4_ptr->hwaddr_), oneaddr_u32,
+                             subnet_id, verdict);
+
             if (debug_logfile)
             {
                 // Write the information to the log file.
@@ -263,6 +434,11 @@ int kea_onelease4(CalloutHandle& handle,
     } catch (const NoSuchCalloutContext&) {
         // No such element in the per-request context (hwaddr_str, oneaddr_str)
     } catch (const EmptyIPv4Str&) {
+        verdict = ONELEASE4_VERDICT_SKIPPED_PREFIX;
+        ONELEASE4_PROBE4(onelease4_verdict,
+                         hwaddr_to_uint64(lease4_ptr->hwaddr_), oneaddr_u32,
+                         subnet_id, verdict);
+
         if (debug_logfile)
         {
             // Write the information to the log file.
@@ -276,6 +452,11 @@ int kea_onelease4(CalloutHandle& handle,
             flush(debug_logfile);
         }
     } catch (const NonMatchingSubnet&) {
+        verdict = ONELEASE4_VERDICT_SKIPPED_SUBNET;
+        ONELEASE4_PROBE4(onelease4_verdict,
+                         hwaddr_to_uint64(lease4_ptr->hwaddr_), oneaddr_u32,
+                         subnet_id, verdict);
+
         if (debug_logfile)
         {
             // Write the information to the log file.
@@ -293,9 +474,365 @@ int kea_onelease4(CalloutHandle& handle,
         }
     }
 
+    ONELEASE4_PROBE4(onelease4_return,
+                     hwaddr_to_uint64(lease4_ptr->hwaddr_), oneaddr_u32,
+                     subnet_id, verdict);
+
+    if (result_verdict)
+        *result_verdict = static_cast<OneLease4Verdict>(verdict);
+    if (result_oneaddr)
+        *result_oneaddr = oneaddr_u32;
+
+    return (KEA_SUCCESS);
+}
+
+int apply_onelease4_verdict(CalloutHandle& handle,
+                            Lease4Ptr lease4_ptr,
+                            const OneLease4Verdict verdict,
+                            const uint32_t oneaddr,
+                            const std::string callout_name)
+{
+    // This does the same as kea_onelease4() but without any checks - the
+    // decision was already made (for the same client, transaction and
+    // subnet)...
+    handle.setContext("onelease_applied", verdict == ONELEASE4_VERDICT_ASSIGNED);
+
+    if (verdict == ONELEASE4_VERDICT_ASSIGNED)
+    {
+        lease4_ptr->addr_ = isc::asiolink::IOAddress(oneaddr);
+    }
+    else if (verdict == ONELEASE4_VERDICT_REJECTED)
+    {
+        handle.setStatus(CalloutHandle::NEXT_STEP_SKIP);
+        lease4_ptr->decline(0);
+    }
+
+    ONELEASE4_PROBE4(onelease4_verdict,
+                     hwaddr_to_uint64(lease4_ptr->hwaddr_),
+                     oneaddr, lease4_ptr->subnet_id_, int(verdict));
+
+    if (debug_logfile)
+    {
+        // Write the information to the log file.
+        debug_logfile \
+            << "DEBUG> " << callout_name << " [CACHED]:" \
+            << " HW address: '" << \
+                (lease4_ptr->hwaddr_ ? lease4_ptr->hwaddr_->toText() : "") \
+            << "'" \
+            << ", Verdict: " << int(verdict) \
+            << ", Actual lease:\n" << lease4_ptr->toText() \
+            << "\n";
+
+        // to guard against a crash, we'll flush the output stream
+        flush(debug_logfile);
+    }
+
     return (KEA_SUCCESS);
 }
 
+OneLease4Verdict check_onelease4(
+        const isc::asiolink::IOAddress &oneaddr,
+        const isc::dhcp::Subnet4Ptr &subnet4_ptr,
+        const std::vector<isc::dhcp::Subnet4Ptr> &subnets)
+{
+    // Do not apply hook if ONE subnet restriction is invalid
+    if (!is_onelease4_in_range(oneaddr, subnets))
+        return ONELEASE4_VERDICT_SKIPPED_SUBNET;
+
+    // The inRange() test is actually redundant because it is also done
+    // in the method inPool() but I know that only because I looked
+    // into the implementation - and that can change so I am defensive
+    // here...
+    if (subnet4_ptr->inRange(oneaddr) &&
+        subnet4_ptr->inPool(Lease::TYPE_V4, oneaddr))
+        return ONELEASE4_VERDICT_ASSIGNED;
+
+    return ONELEASE4_VERDICT_REJECTED;
+}
+
+bool is_onelease4_owner(const Pkt4Ptr &query4_ptr)
+{
+    // load balancing is not used
+    if (kea_onelease4_server_count < 2)
+        return true;
+
+    // Every server has the same configuration (except the index) so they
+    // all compute the same owner for the client without any communication.
+    // ONE address is derived from the HW address so it does not matter
+    // which server is answering the client...
+    HWAddrPtr hwaddr_ptr = query4_ptr->getHWAddr();
+    uint32_t owner =
+        hwaddr_hash(hwaddr_ptr->hwaddr_) % kea_onelease4_server_count;
+
+    if (owner == kea_onelease4_server_index)
+        return true;
+
+    // The client got its lease from us while its owner was down (fallback)
+    // and now it renews/rebinds with us - dropping it would take its address
+    // away at the expiration...
+    if (is_onelease4_addressed(query4_ptr))
+    {
+        if (debug_logfile)
+        {
+            // Write the information to the log file.
+            debug_logfile \
+                << "DEBUG> pkt4_receive [ADDRESSED]:" \
+                << " client of other server is talking to us:" \
+                << " HW address: '" << hwaddr_ptr->toText() << "'" \
+                << ", Owner server: " << owner \
+                << "\n";
+
+            // to guard against a crash, we'll flush the output stream
+            flush(debug_logfile);
+        }
+
+        return true;
+    }
+
+    // The client is trying for some time already - its owner is probably
+    // down so we will answer instead...
+    if ((kea_onelease4_server_fallback_secs > 0) &&
+        (query4_ptr->getSecs() >= kea_onelease4_server_fallback_secs))
+    {
+        StatsMgr::instance().addValue(STAT_PKT4_FALLBACK, int64_t(1));
+        ONELEASE4_PROBE4(onelease4_verdict,
+                         hwaddr_to_uint64(hwaddr_ptr),
+                         uint32_t(0), owner,
+                         int(ONELEASE4_VERDICT_FALLBACK));
+
+        if (debug_logfile)
+        {
+            // Write the information to the log file.
+            debug_logfile \
+                << "DEBUG> pkt4_receive [FALLBACK]:" \
+                << " HW address: '" << hwaddr_ptr->toText() << "'" \
+                << ", Owner server: " << owner \
+                << ", Secs: " << query4_ptr->getSecs() \
+                << "\n";
+
+            // to guard against a crash, we'll flush the output stream
+            flush(debug_logfile);
+        }
+
+        return true;
+    }
+
+    StatsMgr::instance().addValue(STAT_PKT4_NOT_OWNED, int64_t(1));
+    ONELEASE4_PROBE4(onelease4_verdict,
+                     hwaddr_to_uint64(hwaddr_ptr),
+                     uint32_t(0), owner,
+                     int(ONELEASE4_VERDICT_NOT_OWNED));
+
+    if (debug_logfile)
+    {
+        // Write the information to the log file.
+        debug_logfile \
+            << "DEBUG> pkt4_receive [DROPPED]:" \
+            << " client belongs to other server:" \
+            << " HW address: '" << hwaddr_ptr->toText() << "'" \
+            << ", Owner server: " << owner \
+            << "\n";
+
+        // to guard against a crash, we'll flush the output stream
+        flush(debug_logfile);
+    }
+
+    return false;
+}
+
+bool is_onelease4_addressed(const Pkt4Ptr &query4_ptr)
+{
+    // Server identifier (REQUEST in SELECTING state, RELEASE...) - Kea has
+    // already dropped the packets with a server identifier of some other
+    // server before pkt4_receive, so the client has chosen us
+    if (query4_ptr->getOption(DHO_DHCP_SERVER_IDENTIFIER))
+        return true;
+
+    // Unicast from the client itself (RENEWING) - relayed packets are
+    // unicast too but the relay sends them to all servers
+    if (query4_ptr->getGiaddr().isV4Zero() &&
+        !query4_ptr->getLocalAddr().isV4Bcast())
+        return true;
+
+    // Broadcast with the client address (REBINDING) - it goes to all servers
+    // so it is ours only if we have the lease of this client. This is the
+    // only backend read here and it happens only for a rebinding client of
+    // some other server.
+    if (!query4_ptr->getCiaddr().isV4Zero())
+    {
+        Lease4Ptr lease4_ptr =
+            LeaseMgrFactory::instance().getLease4(query4_ptr->getCiaddr());
+        HWAddrPtr hwaddr_ptr = query4_ptr->getHWAddr();
+
+        return (lease4_ptr && lease4_ptr->hwaddr_ && hwaddr_ptr &&
+                (*lease4_ptr->hwaddr_ == *hwaddr_ptr));
+    }
+
+    return false;
+}
+
+bool suppress_onelease4_renew(CalloutHandle& handle,
+                              const isc::asiolink::IOAddress &curaddr,
+                              const uint32_t threshold)
+{
+    // Kea rewrites the lease in the backend on every renewal - but with ONE
+    // lease the address never changes so the only update is the prolonged
+    // lifetime. If the stored lease is still far from its expiration then we
+    // can tell Kea to skip the update (NEXT_STEP_SKIP) - the client is still
+    // answered (Kea restores the original lease values when the renew is
+    // skipped) and pkt4_send shortens the lifetimes in the answer to what
+    // remains of the stored lease.
+    //
+    // The stored lease is not read from the backend (that would cost as much
+    // as the write) - we use what was written the last time instead. Kea
+    // calls lease4_renew only for a lease which it found in the backend, so
+    // we only need to know its lifetime.
+
+    // the ONE lease was rejected by us or by some other callout
+    if (handle.getStatus() != CalloutHandle::NEXT_STEP_CONTINUE)
+        return false;
+
+    bool onelease_applied = false;
+    std::string hwaddr_str;
+    try {
+        handle.getContext("onelease_applied", onelease_applied);
+        handle.getContext("hwaddr_str", hwaddr_str);
+    } catch (const NoSuchCalloutContext&) {
+        return false;
+    }
+
+    // the ONE lease does not apply to this client
+    if (!onelease_applied)
+        return false;
+
+    Lease4Ptr lease4_ptr;
+    handle.getArgument("lease4", lease4_ptr);
+
+    uint64_t hwaddr_u64 = hwaddr_to_uint64(lease4_ptr->hwaddr_);
+
+    // we do not know the stored lease (it was written before the hook was
+    // loaded) or the client is moving to a new address - it must be written
+    auto written = onelease4_writes.find(curaddr.toUint32());
+    if ((lease4_ptr->addr_ != curaddr) ||
+        (written == onelease4_writes.end()) ||
+        (written->second.hwaddr != hwaddr_u64))
+    {
+        record_onelease4_write(lease4_ptr);
+        StatsMgr::instance().addValue(STAT_RENEW_WRITES, int64_t(1));
+        return false;
+    }
+
+    // how much of the valid lifetime still remains (in seconds)
+    uint64_t valid_lft = written->second.valid_lft;
+    int64_t expire = written->second.cltt + static_cast<int64_t>(valid_lft);
+    int64_t now = static_cast<int64_t>(time(NULL));
+    uint64_t remaining = (expire > now) ? (expire - now) : 0;
+
+    // Clients renew at T1 (by default at 50% of the lifetime) so the
+    // threshold must be lower than that or no renew is ever suppressed -
+    // the next renew comes when half of the remaining lifetime passes
+    if ((remaining == 0) || ((remaining * 100) < (valid_lft * threshold)))
+    {
+        record_onelease4_write(lease4_ptr);
+        StatsMgr::instance().addValue(STAT_RENEW_WRITES, int64_t(1));
+        return false;
+    }
+
+    // OK - leave the stored lease as it is and tell pkt4_send what remains
+    handle.setStatus(CalloutHandle::NEXT_STEP_SKIP);
+    handle.setContext("renew_suppressed_lft",
+                      static_cast<uint32_t>(
+                          std::min(remaining, valid_lft)));
+    StatsMgr::instance().addValue(STAT_RENEW_WRITES_SUPPRESSED, int64_t(1));
+
+    ONELEASE4_PROBE4(onelease4_verdict, hwaddr_u64,
+                     curaddr.toUint32(), lease4_ptr->subnet_id_,
+                     int(ONELEASE4_VERDICT_RENEW_SUPPRESSED));
+
+    if (debug_logfile)
+    {
+        // Write the information to the log file.
+        debug_logfile \
+            << "DEBUG> lease4_renew [WRITE SUPPRESSED]:" \
+            << " HW address: '" << hwaddr_str << "'" \
+            << ", Leased IP: '" << curaddr.toText() << "'" \
+            << ", Remaining lifetime: " << remaining << "s" \
+            << " of " << valid_lft << "s" \
+            << "\n";
+
+        // to guard against a crash, we'll flush the output stream
+        flush(debug_logfile);
+    }
+
+    return true;
+}
+
+void record_onelease4_write(const Lease4Ptr &lease4_ptr)
+{
+    OneLease4Write &written = onelease4_writes[lease4_ptr->addr_.toUint32()];
+
+    written.hwaddr = hwaddr_to_uint64(lease4_ptr->hwaddr_);
+    written.cltt = static_cast<int64_t>(lease4_ptr->cltt_);
+    written.valid_lft = lease4_ptr->valid_lft_;
+}
+
+void clear_onelease4_writes()
+{
+    onelease4_writes.clear();
+}
+
+void set_onelease4_lifetimes(const Pkt4Ptr &response4_ptr,
+                             const uint32_t valid_lft)
+{
+    OptionUint32Ptr lease_time = boost::dynamic_pointer_cast<OptionUint32>(
+            response4_ptr->getOption(DHO_DHCP_LEASE_TIME));
+    if (!lease_time || (lease_time->getValue() == 0))
+        return;
+
+    uint64_t orig_lft = lease_time->getValue();
+    lease_time->setValue(valid_lft);
+
+    // T1 and T2 (if sent) keep their ratio to the lifetime - if they are not
+    // sent then the client computes them from the lifetime itself. The
+    // product needs 64 bits (day long lifetimes overflow 32 bits) and the
+    // rounding must not break the order T1 < T2 < lease time.
+    OptionUint32Ptr t1 = boost::dynamic_pointer_cast<OptionUint32>(
+            response4_ptr->getOption(DHO_DHCP_RENEWAL_TIME));
+    OptionUint32Ptr t2 = boost::dynamic_pointer_cast<OptionUint32>(
+            response4_ptr->getOption(DHO_DHCP_REBINDING_TIME));
+
+    uint64_t upper = valid_lft;
+    if (t2)
+    {
+        uint64_t t2_value =
+            static_cast<uint64_t>(t2->getValue()) * valid_lft / orig_lft;
+        t2_value = std::min(t2_value, (upper > 0) ? (upper - 1) : 0);
+        t2->setValue(static_cast<uint32_t>(t2_value));
+        upper = t2_value;
+    }
+    if (t1)
+    {
+        uint64_t t1_value =
+            static_cast<uint64_t>(t1->getValue()) * valid_lft / orig_lft;
+        t1_value = std::min(t1_value, (upper > 0) ? (upper - 1) : 0);
+        t1->setValue(static_cast<uint32_t>(t1_value));
+    }
+
+    if (debug_logfile)
+    {
+        // Write the information to the log file.
+        debug_logfile \
+            << "DEBUG> pkt4_send [LIFETIME SHORTENED]:" \
+            << " Leased IP: '" << response4_ptr->getYiaddr().toText() << "'" \
+            << ", Lifetime: " << valid_lft << "s" \
+            << " (instead of " << orig_lft << "s)" \
+            << "\n";
+
+        // to guard against a crash, we'll flush the output stream
+        flush(debug_logfile);
+    }
+}
+
 bool match_byte_prefix(const std::vector<uint8_t> &byte_prefix,
                        const std::vector<uint8_t> &hw_addr)
 {
@@ -0,0 +1,37 @@
+/*
+ *
+ * Copyright (2019) Petr Ospalý <petr@ospalax.cz>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ */
+
+
+#include "h/probes.h"
+
+
+/* Code section */
+
+#ifdef ONELEASE4_USDT
+
+// Semaphores of the USDT probes - tracers find them in the '.probes' section
+// and increment them when they attach to the probe
+#define ONELEASE4_SEMAPHORE_DEFINE(name) \
+    volatile unsigned short ONELEASE4_SEMAPHORE(name) \
+        __attribute__((unused)) __attribute__((section(".probes"))) = 0
+
+extern "C" {
+    ONELEASE4_SEMAPHORE_DEFINE(pkt4_receive_entry);
+    ONELEASE4_SEMAPHORE_DEFINE(pkt4_receive_return);
+    ONELEASE4_SEMAPHORE_DEFINE(onelease4_entry);
+    ONELEASE4_SEMAPHORE_DEFINE(onelease4_verdict);
+    ONELEASE4_SEMAPHORE_DEFINE(onelease4_return);
+    ONELEASE4_SEMAPHORE_DEFINE(pkt4_send);
+}
+
+#endif
+
+
+// last line
@@ -0,0 +1,113 @@
+#!/bin/sh
+
+#
+# Copyright (2019) Petr Ospalý <petr@ospalax.cz>
+#
+# This Source Code Form is subject to the terms of the Mozilla Public
+# License, v. 2.0. If a copy of the MPL was not distributed with this
+# file, You can obtain one at http://mozilla.org/MPL/2.0/.
+#
+
+#
+# Benchmark of the decision cache ('decision-cache-ttl')
+#
+# perfdhcp runs the whole DORA exchange (DISCOVER, OFFER, REQUEST, ACK) for
+# CLIENTS clients at RATE exchanges per second for DURATION seconds - once
+# with the cache disabled (ttl 0) and once enabled (ttl CACHE_TTL), RUNS
+# times each. The reported rate is what perfdhcp achieved, so RATE should be
+# higher than what the server can handle.
+#
+# The leases are kept only in memory (memfile without persistence) unless
+# LEASE_PERSIST=true - otherwise the file writes would hide the difference.
+#
+# Usage (as root):
+#   % RATE=20000 RUNS=5 ./tools/bench-dora.sh
+#
+
+set -e
+
+. "$(dirname "$0")/common.sh"
+
+CLIENTS="${CLIENTS:-50000}"
+RATE="${RATE:-10000}"
+DURATION="${DURATION:-30}"
+RUNS="${RUNS:-3}"
+CACHE_TTL="${CACHE_TTL:-10}"
+LEASE_PERSIST="${LEASE_PERSIST:-false}"
+
+WORKDIR=$(mktemp -d)
+
+#
+# functions
+#
+
+on_exit()
+{
+    # this is the exit handler - I want to clean up as much as I can
+    set +e
+
+    netns_cleanup
+
+    echo "Work directory (configs, logs, perfdhcp output): ${WORKDIR}"
+}
+
+# arg: <perfdhcp output>
+dora_rate()
+{
+    sed -n 's/^Rate: \([0-9.]*\) 4-way exchanges.*/\1/p' "$1"
+}
+
+#
+# main
+#
+
+require_root
+require_commands ip socat "$KEA_DHCP4" "$PERFDHCP"
+
+trap 'on_exit 2>/dev/null' INT QUIT TERM EXIT
+
+netns_setup
+netns_add_host server 10.79.0.1/16
+netns_add_host client 10.79.0.2/16
+
+RESULTS="${WORKDIR}/results"
+printf '%-4s %-10s %14s %12s %12s %12s\n' \
+    RUN CACHE-TTL DORA-PER-SEC ACKS CACHE-HITS CACHE-MISSES \
+    > "$RESULTS"
+
+_run=1
+while [ "$_run" -le "$RUNS" ] ; do
+    for _ttl in 0 "$CACHE_TTL" ; do
+        _config="${WORKDIR}/kea-${_run}-${_ttl}.json"
+
+        kea_write_config "$_config" \
+            "{ \"type\": \"memfile\", \"persist\": ${LEASE_PERSIST},
+               \"lfc-interval\": 0,
+               \"name\": \"${WORKDIR}/leases-${_run}-${_ttl}.csv\" }" \
+            "{ \"byte-prefix\": \"02:00\",
+               \"decision-cache-ttl\": ${_ttl} }"
+
+        kea_start server "$_config"
+
+        # ONE MAC addresses: 02:00 + IPv4 address from the pool
+        netns_exec client "$PERFDHCP" -4 -l eth0 \
+            -b mac=02:00:0a:4f:01:00 -R "$CLIENTS" \
+            -r "$RATE" -p "$DURATION" \
+            > "${_config}.perfdhcp" 2>&1 || true
+
+        printf '%-4s %-10s %14s %12s %12s %12s\n' \
+            "$_run" "$_ttl" \
+            "$(dora_rate "${_config}.perfdhcp")" \
+            "$(kea_stat "$_config" pkt4-ack-sent)" \
+            "$(kea_stat "$_config" onelease4-decision-cache-hits)" \
+            "$(kea_stat "$_config" onelease4-decision-cache-misses)" \
+            >> "$RESULTS"
+
+        kea_stop server
+    done
+    _run=$(( _run + 1 ))
+done
+
+cat "$RESULTS"
+
+exit 0
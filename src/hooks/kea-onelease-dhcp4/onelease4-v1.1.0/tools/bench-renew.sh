@@ -0,0 +1,160 @@
+#!/bin/sh
+
+#
+# Copyright (2019) Petr Ospalý <petr@ospalax.cz>
+#
+# This Source Code Form is subject to the terms of the Mozilla Public
+# License, v. 2.0. If a copy of the MPL was not distributed with this
+# file, You can obtain one at http://mozilla.org/MPL/2.0/.
+#
+
+#
+# Benchmark of the renew write suppression ('renew-skip-write')
+#
+# perfdhcp acquires leases for CLIENTS clients and then keeps renewing them
+# for DURATION seconds - once with the suppression disabled and once enabled,
+# for each of the lease backends in BACKENDS. The writes are counted by the
+# backend itself:
+#
+#   memfile - lines appended to the lease file (every write is one line)
+#   pgsql   - inserted and updated rows of the lease4 table (pg_stat)
+#
+# PostgreSQL database must be already initialized (kea-admin db-init pgsql)
+# and it is emptied before every run!
+#
+# Usage (as root):
+#   % BACKENDS="memfile pgsql" PGSQL_HOST=... ./tools/bench-renew.sh
+#
+
+set -e
+
+. "$(dirname "$0")/common.sh"
+
+BACKENDS="${BACKENDS:-memfile}"
+CLIENTS="${CLIENTS:-1000}"
+RATE="${RATE:-200}"
+RENEW_RATE="${RENEW_RATE:-500}"
+DURATION="${DURATION:-30}"
+
+PGSQL_HOST="${PGSQL_HOST:-localhost}"
+PGSQL_NAME="${PGSQL_NAME:-kea}"
+PGSQL_USER="${PGSQL_USER:-kea}"
+PGSQL_PASSWORD="${PGSQL_PASSWORD:-kea}"
+
+WORKDIR=$(mktemp -d)
+
+#
+# functions
+#
+
+on_exit()
+{
+    # this is the exit handler - I want to clean up as much as I can
+    set +e
+
+    netns_cleanup
+
+    echo "Work directory (configs, logs, perfdhcp output): ${WORKDIR}"
+}
+
+pgsql()
+{
+    PGPASSWORD="$PGSQL_PASSWORD" psql -h "$PGSQL_HOST" -U "$PGSQL_USER" \
+        -d "$PGSQL_NAME" -t -A -c "$1"
+}
+
+# arg: <backend> <lease file>
+lease_database()
+{
+    case "$1" in
+        memfile)
+            echo "{ \"type\": \"memfile\", \"persist\": true," \
+                "\"lfc-interval\": 0, \"name\": \"$2\" }"
+            ;;
+        pgsql)
+            echo "{ \"type\": \"postgresql\", \"host\": \"${PGSQL_HOST}\"," \
+                "\"name\": \"${PGSQL_NAME}\", \"user\": \"${PGSQL_USER}\"," \
+                "\"password\": \"${PGSQL_PASSWORD}\" }"
+            ;;
+    esac
+}
+
+# arg: <backend> <lease file>
+backend_writes()
+{
+    case "$1" in
+        memfile)
+            # without the CSV header
+            echo $(( $(wc -l < "$2") - 1 ))
+            ;;
+        pgsql)
+            # statistics are sent to the collector with a delay
+            sleep 2
+            pgsql "SELECT n_tup_ins + n_tup_upd FROM pg_stat_user_tables
+                   WHERE relname = 'lease4';"
+            ;;
+    esac
+}
+
+#
+# main
+#
+
+require_root
+require_commands ip socat "$KEA_DHCP4" "$PERFDHCP"
+case " $BACKENDS " in
+    *" pgsql "*)
+        require_commands psql
+        ;;
+esac
+
+trap 'on_exit 2>/dev/null' INT QUIT TERM EXIT
+
+netns_setup
+netns_add_host server 10.79.0.1/16
+netns_add_host client 10.79.0.2/16
+
+RESULTS="${WORKDIR}/results"
+printf '%-8s %-12s %10s %14s %14s %14s\n' \
+    BACKEND SKIP-WRITE REQUESTS HOOK-WRITES HOOK-SKIPPED BACKEND-WRITES \
+    > "$RESULTS"
+
+for _backend in $BACKENDS ; do
+    for _skip in false true ; do
+        _config="${WORKDIR}/kea-${_backend}-${_skip}.json"
+        _leases="${WORKDIR}/leases-${_backend}-${_skip}.csv"
+
+        kea_write_config "$_config" \
+            "$(lease_database "$_backend" "$_leases")" \
+            "{ \"byte-prefix\": \"02:00\", \"renew-skip-write\": ${_skip} }"
+
+        if [ "$_backend" = pgsql ] ; then
+            pgsql "DELETE FROM lease4;" >/dev/null
+        fi
+
+        kea_start server "$_config"
+        _writes_before=$(backend_writes "$_backend" "$_leases")
+
+        # ONE MAC addresses: 02:00 + IPv4 address from the pool
+        netns_exec client "$PERFDHCP" -4 -l eth0 \
+            -b mac=02:00:0a:4f:01:00 -R "$CLIENTS" \
+            -r "$RATE" -f "$RENEW_RATE" -p "$DURATION" \
+            > "${_config}.perfdhcp" 2>&1 || true
+
+        _writes_after=$(backend_writes "$_backend" "$_leases")
+
+        printf '%-8s %-12s %10s %14s %14s %14s\n' \
+            "$_backend" "$_skip" \
+            "$(kea_stat "$_config" pkt4-request-received)" \
+            "$(kea_stat "$_config" onelease4-renew-writes)" \
+            "$(kea_stat "$_config" onelease4-renew-writes-suppressed)" \
+            "$(( _writes_after - _writes_before ))" \
+            >> "$RESULTS"
+
+        kea_stop server
+    done
+done
+
+cat "$RESULTS"
+
+exit 0
@@ -0,0 +1,191 @@
+#!/bin/sh
+
+#
+# Copyright (2019) Petr Ospalý <petr@ospalax.cz>
+#
+# This Source Code Form is subject to the terms of the Mozilla Public
+# License, v. 2.0. If a copy of the MPL was not distributed with this
+# file, You can obtain one at http://mozilla.org/MPL/2.0/.
+#
+
+#
+# Shared functions for the ONElease4 test and benchmark scripts - it is meant
+# to be sourced, not executed...
+#
+# Every server and client runs in its own network namespace and all of them
+# are connected to one bridge (inside of its own namespace too) - nothing is
+# touched in the host's network.
+#
+
+KEA_INSTALLPREFIX="${KEA_INSTALLPREFIX:-/usr/local}"
+KEA_DHCP4="${KEA_DHCP4:-${KEA_INSTALLPREFIX}/sbin/kea-dhcp4}"
+PERFDHCP="${PERFDHCP:-${KEA_INSTALLPREFIX}/sbin/perfdhcp}"
+ONELEASE4_LIB="${ONELEASE4_LIB:-${KEA_INSTALLPREFIX}/lib/kea/hooks/libkea-onelease-dhcp4.so}"
+
+# prefix of all network namespaces (and so the cleanup knows what is ours)
+NETNS_PREFIX="${NETNS_PREFIX:-onelease4}"
+
+#
+# functions
+#
+
+# arg: <command>...
+require_commands()
+{
+    for _cmd in "$@" ; do
+        if ! command -v "$_cmd" >/dev/null 2>&1 ; then
+            echo "ERROR: Command '${_cmd}' is missing" 1>&2
+            exit 1
+        fi
+    done
+}
+
+require_root()
+{
+    if [ "$(id -u)" -ne 0 ] ; then
+        echo "ERROR: Network namespaces need root privileges" 1>&2
+        exit 1
+    fi
+}
+
+netns_setup()
+{
+    ip netns add "${NETNS_PREFIX}-br"
+    ip -n "${NETNS_PREFIX}-br" link add br0 type bridge
+    ip -n "${NETNS_PREFIX}-br" link set br0 up
+}
+
+# arg: <host name> <address/prefix> [<mac>]
+netns_add_host()
+{
+    _ns="${NETNS_PREFIX}-$1"
+
+    ip netns add "$_ns"
+    ip -n "${NETNS_PREFIX}-br" link add "$1" type veth peer name eth0 \
+        netns "$_ns"
+    ip -n "${NETNS_PREFIX}-br" link set "$1" master br0 up
+
+    if [ -n "$3" ] ; then
+        ip -n "$_ns" link set eth0 address "$3"
+    fi
+
+    ip -n "$_ns" link set lo up
+    ip -n "$_ns" link set eth0 up
+
+    if [ -n "$2" ] ; then
+        ip -n "$_ns" addr add "$2" dev eth0
+    fi
+}
+
+# arg: <host name> <command>...
+netns_exec()
+{
+    _ns="${NETNS_PREFIX}-$1"
+    shift
+    ip netns exec "$_ns" "$@"
+}
+
+netns_cleanup()
+{
+    for _ns in $(ip netns list | awk '{print $1}' | grep "^${NETNS_PREFIX}-") ; do
+        for _pid in $(ip netns pids "$_ns") ; do
+            kill "$_pid" 2>/dev/null
+        done
+        sleep 1
+        for _pid in $(ip netns pids "$_ns") ; do
+            kill -9 "$_pid" 2>/dev/null
+        done
+        ip netns del "$_ns"
+    done
+}
+
+# arg: <config file> <lease database (json)> <hook parameters (json)>
+#
+# Optional variables: KEA_SUBNET, KEA_POOL, KEA_VALID_LIFETIME,
+#                     KEA_RENEW_TIMER, KEA_REBIND_TIMER
+kea_write_config()
+{
+    cat > "$1" <<EOF
+{
+"Dhcp4": {
+    "interfaces-config": {
+        "interfaces": [ "eth0" ]
+    },
+    "control-socket": {
+        "socket-type": "unix",
+        "socket-name": "${1}.sock"
+    },
+    "lease-database": $2,
+    "valid-lifetime": ${KEA_VALID_LIFETIME:-3600},
+    "renew-timer": ${KEA_RENEW_TIMER:-1800},
+    "rebind-timer": ${KEA_REBIND_TIMER:-3150},
+    "subnet4": [
+        {
+            "subnet": "${KEA_SUBNET:-10.79.0.0/16}",
+            "pools": [ { "pool": "${KEA_POOL:-10.79.1.0 - 10.79.255.254}" } ]
+        }
+    ],
+    "hooks-libraries": [
+        {
+            "library": "${ONELEASE4_LIB}",
+            "parameters": $3
+        }
+    ],
+    "loggers": [
+        {
+            "name": "kea-dhcp4",
+            "output_options": [ { "output": "${1}.log" } ],
+            "severity": "WARN"
+        }
+    ]
+}
+}
+EOF
+}
+
+# arg: <host name> <config file>
+kea_start()
+{
+    # keep pid and lock files out of the installation
+    netns_exec "$1" env \
+        KEA_PIDFILE_DIR="$(dirname "$2")" \
+        KEA_LOCKFILE_DIR="$(dirname "$2")" \
+        "$KEA_DHCP4" -c "$2" >"${2}.out" 2>&1 &
+
+    # wait for the control socket
+    _i=0
+    while ! [ -S "${2}.sock" ] ; do
+        _i=$(( _i + 1 ))
+        if [ "$_i" -gt 50 ] ; then
+            echo "ERROR: kea-dhcp4 did not start (see: ${2}.out)" 1>&2
+            return 1
+        fi
+        sleep 0.2
+    done
+}
+
+# arg: <host name>
+kea_stop()
+{
+    for _pid in $(ip netns pids "${NETNS_PREFIX}-$1") ; do
+        kill "$_pid" 2>/dev/null
+    done
+    sleep 1
+}
+
+# arg: <config file> <command (json)>
+kea_command()
+{
+    echo "$2" | socat -t 5 - "UNIX-CONNECT:${1}.sock"
+}
+
+# arg: <config file> <statistic name>
+kea_stat()
+{
+    _value=$(kea_command "$1" \
+        "{ \"command\": \"statistic-get\", \"arguments\": { \"name\": \"$2\" } }" \
+        | tr -d ' \n' \
+        | sed -n 's/.*"'"$2"'":\[\[\([0-9]*\),.*/\1/p')
+
+    echo "${_value:-0}"
+}
@@ -0,0 +1,198 @@
+#!/bin/sh
+
+#
+# Copyright (2019) Petr Ospalý <petr@ospalax.cz>
+#
+# This Source Code Form is subject to the terms of the Mozilla Public
+# License, v. 2.0. If a copy of the MPL was not distributed with this
+# file, You can obtain one at http://mozilla.org/MPL/2.0/.
+#
+
+#
+# Test of the load balancing ('server-count', 'server-fallback-secs')
+#
+# Two servers (each in its own network namespace) share the clients and one
+# dhclient plays the client which belongs to the server 0:
+#
+#   1. both servers are up - only the server 0 answers the client
+#   2. the server 0 is stopped - the server 1 must answer the client after
+#      'server-fallback-secs' and then it must keep answering its renewals
+#      (they are unicast to the server 1 so they are never dropped)
+#
+# Usage (as root):
+#   % ./tools/test-loadbalance.sh
+#
+
+set -e
+
+. "$(dirname "$0")/common.sh"
+
+# ONE MAC address of the client owned by the server 0 (hash % 2 == 0)
+CLIENT_MAC="02:00:0a:4f:01:0b"
+CLIENT_ONEADDR="10.79.1.11"
+
+FALLBACK_SECS="${FALLBACK_SECS:-3}"
+LEASE_TIMEOUT="${LEASE_TIMEOUT:-60}"
+
+# short lifetimes - the client renews every few seconds
+KEA_VALID_LIFETIME="${KEA_VALID_LIFETIME:-20}"
+KEA_RENEW_TIMER="${KEA_RENEW_TIMER:-5}"
+KEA_REBIND_TIMER="${KEA_REBIND_TIMER:-15}"
+
+WORKDIR=$(mktemp -d)
+
+#
+# functions
+#
+
+on_exit()
+{
+    # this is the exit handler - I want to clean up as much as I can
+    set +e
+
+    netns_cleanup
+
+    echo "Work directory (configs, logs, dhclient output): ${WORKDIR}"
+}
+
+fail()
+{
+    echo "FAIL: $*" 1>&2
+    exit 1
+}
+
+# arg: <server index>
+server_config()
+{
+    _config="${WORKDIR}/kea-$1.json"
+
+    kea_write_config "$_config" \
+        "{ \"type\": \"memfile\", \"persist\": true, \"lfc-interval\": 0,
+           \"name\": \"${WORKDIR}/leases-$1.csv\" }" \
+        "{ \"byte-prefix\": \"02:00\", \"server-index\": $1,
+           \"server-count\": 2,
+           \"server-fallback-secs\": ${FALLBACK_SECS} }"
+
+    echo "$_config"
+}
+
+# dhclient only configures the address - no routes, no resolv.conf...
+write_dhclient_script()
+{
+    cat > "${WORKDIR}/dhclient-script" <<EOF
+#!/bin/sh
+case "\$reason" in
+    BOUND|RENEW|REBIND|REBOOT)
+        ip addr replace "\${new_ip_address}/16" dev "\$interface"
+        ;;
+    EXPIRE|FAIL|RELEASE|STOP)
+        ip addr flush dev "\$interface"
+        ;;
+esac
+exit 0
+EOF
+    chmod +x "${WORKDIR}/dhclient-script"
+}
+
+# arg: <run name>
+dhclient_start()
+{
+    netns_exec client dhclient -4 -d -v \
+        -sf "${WORKDIR}/dhclient-script" \
+        -pf "${WORKDIR}/dhclient-$1.pid" \
+        -lf "${WORKDIR}/dhclient-$1.leases" \
+        eth0 > "${WORKDIR}/dhclient-$1.out" 2>&1 &
+}
+
+dhclient_stop()
+{
+    for _pidfile in "${WORKDIR}"/dhclient-*.pid ; do
+        if [ -f "$_pidfile" ] ; then
+            kill "$(cat "$_pidfile")" 2>/dev/null || true
+            rm -f "$_pidfile"
+        fi
+    done
+    netns_exec client ip addr flush dev eth0
+}
+
+wait_for_lease()
+{
+    _i=0
+    while ! netns_exec client ip -4 addr show dev eth0 \
+        | grep -q " ${CLIENT_ONEADDR}/" ; do
+        _i=$(( _i + 1 ))
+        if [ "$_i" -gt "$LEASE_TIMEOUT" ] ; then
+            return 1
+        fi
+        sleep 1
+    done
+}
+
+#
+# main
+#
+
+require_root
+require_commands ip socat dhclient "$KEA_DHCP4"
+
+trap 'on_exit 2>/dev/null' INT QUIT TERM EXIT
+
+netns_setup
+netns_add_host server0 10.79.0.1/16
+netns_add_host server1 10.79.0.2/16
+netns_add_host client "" "$CLIENT_MAC"
+
+write_dhclient_script
+CONFIG0=$(server_config 0)
+CONFIG1=$(server_config 1)
+
+kea_start server0 "$CONFIG0"
+kea_start server1 "$CONFIG1"
+
+# 1. both servers are up
+
+echo "TEST: client is answered by its owner (server 0)"
+
+dhclient_start owner
+wait_for_lease || fail "client did not get ${CLIENT_ONEADDR}"
+
+[ "$(kea_stat "$CONFIG0" pkt4-ack-sent)" -gt 0 ] \
+    || fail "server 0 did not acknowledge the lease"
+[ "$(kea_stat "$CONFIG1" pkt4-ack-sent)" -eq 0 ] \
+    || fail "server 1 acknowledged the lease of the server 0 client"
+[ "$(kea_stat "$CONFIG1" onelease4-pkt4-not-owned)" -gt 0 ] \
+    || fail "server 1 did not drop the server 0 client"
+
+dhclient_stop
+
+# 2. owner is down
+
+echo "TEST: client falls back to server 1 and keeps renewing with it"
+
+kea_stop server0
+
+dhclient_start fallback
+wait_for_lease || fail "client did not get ${CLIENT_ONEADDR} from server 1"
+
+[ "$(kea_stat "$CONFIG1" onelease4-pkt4-fallback)" -gt 0 ] \
+    || fail "server 1 did not answer as a fallback"
+
+# drops are expected only until the client's secs reaches the fallback
+_dropped=$(kea_stat "$CONFIG1" onelease4-pkt4-not-owned)
+_acks=$(kea_stat "$CONFIG1" pkt4-ack-sent)
+
+# a few renewals (and one lifetime - the lease must not expire)
+sleep "$(( KEA_VALID_LIFETIME + KEA_RENEW_TIMER ))"
+
+[ "$(kea_stat "$CONFIG1" pkt4-ack-sent)" -ge "$(( _acks + 2 ))" ] \
+    || fail "server 1 did not acknowledge the renewals"
+[ "$(kea_stat "$CONFIG1" onelease4-pkt4-not-owned)" -eq "$_dropped" ] \
+    || fail "server 1 dropped the renewals of its fallback client"
+netns_exec client ip -4 addr show dev eth0 | grep -q " ${CLIENT_ONEADDR}/" \
+    || fail "client lost its lease"
+
+dhclient_stop
+
+echo "OK"
+
+exit 0